@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new/delete with versions that count what goes
+// through them. Replacement allocation functions must be defined once per
+// program, so include this in exactly one translation unit.
+
+struct AllocationCount {
+    size_t allocations = 0;
+    size_t bytes = 0;
+};
+
+inline AllocationCount allocation_count;
+
+// What was allocated between construction and now()
+class AllocationScope {
+    public:
+        AllocationScope() : m_start(allocation_count) {}
+
+        AllocationCount now() const {
+            return AllocationCount{allocation_count.allocations - m_start.allocations,
+                                   allocation_count.bytes - m_start.bytes};
+        }
+
+    private:
+        AllocationCount m_start;
+};
+
+void* operator new(size_t size) {
+    allocation_count.allocations++;
+    allocation_count.bytes += size;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
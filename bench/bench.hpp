@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Shared helpers for the benchmarks. Build them with optimizations on
+// (-DCMAKE_BUILD_TYPE=Release) for figures worth comparing.
+
+inline std::string read_file(const char* path) {
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input) {
+        std::cerr << "Error: could not open " << path << std::endl;
+        std::exit(1);
+    }
+    std::string contents(static_cast<size_t>(input.tellg()), '\0');
+    input.seekg(0);
+    input.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+    return contents;
+}
+
+// Fastest of `runs` calls to `f`, in seconds
+template <typename F>
+double best_of(int runs, F&& f) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// A distinct identifier for each n. Identifiers are letters only:
+// 0 -> "va", 25 -> "vz", 26 -> "vba", ...
+inline std::string name_of(size_t n) {
+    std::string name;
+    do {
+        name.insert(name.begin(), static_cast<char>('a' + n % 26));
+        n /= 26;
+    } while (n != 0);
+    return "v" + name;
+}
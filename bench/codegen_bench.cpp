@@ -0,0 +1,113 @@
+// Back-end time on deeply nested scopes: everything after parsing, from the
+// binder to the assembly text, against the baseline generator that returned
+// a std::string from every generate_* call.
+//
+//     codegen_bench [depth...]
+//
+// Each program nests `depth` if-scopes, every one declaring a variable and
+// assigning to one declared outside it:
+//
+//     let va = 1;
+//     if (va) {
+//         let vb = va + 1;
+//         va = vb * 2;
+//         if (vb) {
+//             ...
+//         }
+//     }
+//     exit(va);
+//
+// The baseline copies each scope's text into its parent's, so its time grows
+// with the square of the depth. The current back end is timed at -O0, where
+// every variable stays in its stack slot as in the baseline, and at -O2.
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "binder.hpp"
+#include "emitter.hpp"
+#include "fold.hpp"
+#include "generation.hpp"
+#include "passes.hpp"
+#include "peephole.hpp"
+#include "baseline/generation.hpp"
+
+static std::string generate_nested(size_t depth) {
+    std::string src = "let " + name_of(0) + " = 1;\n";
+    for (size_t i = 1; i <= depth; i++) {
+        src += "if (" + name_of(i - 1) + ") {\n";
+        src += "let " + name_of(i) + " = " + name_of(i - 1) + " + 1;\n";
+        src += name_of(i - 1) + " = " + name_of(i) + " * 2;\n";
+    }
+    src += std::string(depth, '}') + "\nexit(" + name_of(0) + ");\n";
+    return src;
+}
+
+// Parse, then time binding, folding, building and optimizing the IR,
+// generating and emitting, as the driver does them; returns the seconds
+static double back_end(const std::string& src, OptLevel level) {
+    Tokenizer tokenizer(src);
+    TokenStream tokens(tokenizer);
+    Parser parser(tokens, src);
+    NodeProgram program = parser.parse();
+
+    const auto start = std::chrono::steady_clock::now();
+    Binder binder(program, tokenizer);
+    ConstantFolder folder(program, tokenizer);
+    if (!binder.bind() || !folder.fold()) {
+        std::exit(1);
+    }
+    IrProgram ir = IrBuilder(program).build();
+    PassManager(level, PassOptions{}, std::cerr).run(ir);
+    std::vector<Instr> code = Generator(ir).generate_program();
+    if (level != OptLevel::O0) {
+        Peephole().run(code);
+    }
+    Emitter out(src.size() * 4);
+    write_program(out, code);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static double baseline_back_end(const std::string& src) {
+    baseline::Tokenizer tokenizer(src);
+    baseline::Parser parser(tokenizer.tokenize());
+    baseline::NodeProgram program = parser.parse();
+    const auto start = std::chrono::steady_clock::now();
+    const std::string code = baseline::Generator(std::move(program)).generate_program();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> depths;
+    for (int i = 1; i < argc; i++) {
+        depths.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (depths.empty()) {
+        depths = {1000, 2000, 4000, 8000};
+    }
+    const int runs = 3;
+
+    std::cout << "back end, best of " << runs << " (ms)\n";
+    std::cout << std::setw(8) << "depth" << std::setw(12) << "baseline" << std::setw(12) << "-O0"
+              << std::setw(12) << "-O2" << "\n";
+    for (size_t depth : depths) {
+        const std::string src = generate_nested(depth);
+        double old = 1e30;
+        double o0 = 1e30;
+        double o2 = 1e30;
+        for (int i = 0; i < runs; i++) {
+            old = std::min(old, baseline_back_end(src));
+            o0 = std::min(o0, back_end(src, OptLevel::O0));
+            o2 = std::min(o2, back_end(src, OptLevel::O2));
+        }
+
+        std::cout << std::fixed << std::setprecision(2) << std::setw(8) << depth << std::setw(12) << old * 1000
+                  << std::setw(12) << o0 * 1000 << std::setw(12) << o2 * 1000 << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Parse cost of the flat-table AST against the baseline shared_ptr tree:
+// heap allocations, AST nodes and time to tokenize and parse.
+//
+//     parse_bench [blocks | file.hy]
+//
+// By default the input is big-eq.hy scaled up: 20000 blocks of nine lets
+// and a parenthesized sum of the nine (about 4.6 MB). Both parsers are fed
+// the same text; the baseline one lexes it into a token vector first, the
+// current one pulls tokens while parsing, so both timings include lexing.
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <string_view>
+
+#include "alloc_counter.hpp"
+#include "bench.hpp"
+#include "parser.hpp"
+#include "baseline/parser.hpp"
+
+static std::string generate_big_eq(size_t blocks) {
+    std::string src;
+    size_t next = 0;
+    for (size_t block = 0; block < blocks; block++) {
+        const size_t first = next;
+        for (int i = 1; i <= 9; i++) {
+            src += "let " + name_of(next++) + " = " + std::to_string(i) + ";\n";
+        }
+        std::string sum = name_of(first);
+        for (size_t i = first + 1; i < next; i++) {
+            sum = "(" + sum + " + " + name_of(i) + ")";
+        }
+        src += "let " + name_of(next++) + " = " + sum + ";\n";
+    }
+    src += "exit(" + name_of(next - 1) + ");\n";
+    return src;
+}
+
+static size_t node_count(const NodeProgram& program) {
+    return program.exprs.size() + program.statements.size() + program.scopes.size() + program.predicates.size();
+}
+
+int main(int argc, char* argv[]) {
+    std::string src;
+    if (argc > 1 && std::string_view(argv[1]).ends_with(".hy")) {
+        src = read_file(argv[1]);
+    } else {
+        src = generate_big_eq(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000);
+    }
+    const int runs = 5;
+
+    // Counted on a first, cold run: that is what one compilation pays,
+    // interning every identifier included
+    size_t nodes = 0;
+    AllocationCount current_allocs;
+    auto parse_current = [&] {
+        Tokenizer tokenizer(src);
+        TokenStream tokens(tokenizer);
+        Parser parser(tokens, src);
+        const NodeProgram program = parser.parse();
+        nodes = node_count(program);
+    };
+    {
+        AllocationScope scope;
+        parse_current();
+        current_allocs = scope.now();
+    }
+    const double current = best_of(runs, parse_current);
+
+    AllocationCount baseline_allocs;
+    auto parse_baseline = [&] {
+        baseline::Tokenizer tokenizer(src);
+        baseline::Parser parser(tokenizer.tokenize());
+        const baseline::NodeProgram program = parser.parse();
+    };
+    {
+        AllocationScope scope;
+        parse_baseline();
+        baseline_allocs = scope.now();
+    }
+    const double old = best_of(runs, parse_baseline);
+
+    std::cout << std::fixed << std::setprecision(1) << static_cast<double>(src.size()) / 1e6
+              << " MB, best of " << runs << "\n";
+    std::cout << "  baseline    " << std::setw(8) << old * 1000 << " ms  " << baseline_allocs.allocations
+              << " heap allocations, " << baseline_allocs.bytes / 1024 << " KiB\n";
+    std::cout << "  flat tables " << std::setw(8) << current * 1000 << " ms  " << current_allocs.allocations
+              << " heap allocations, " << current_allocs.bytes / 1024 << " KiB, " << nodes << " AST nodes\n";
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Tokenizer throughput in MB/s: the table-driven lexer against the baseline
+// one it replaced.
+//
+//     tokenizer_bench [file.hy]
+//
+// Without a file, a ~16 MB program is generated from the subset of the
+// language the baseline tokenizer understands (no comparison operators),
+// with identifiers, keywords, literals, whitespace and both comment styles.
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+
+#include "bench.hpp"
+#include "tokenization.hpp"
+#include "baseline/tokenization.hpp"
+
+static std::string generate_program(size_t target_bytes) {
+    std::string src;
+    for (size_t i = 0; src.size() < target_bytes; i++) {
+        const std::string n = std::to_string(i);
+        src += "// block " + n + "\n";
+        src += "let value" + n + " = (alpha + " + n + "7) * beta / 13 - gamma;\n";
+        src += "if (value" + n + ") {\n    alpha = alpha + 1;\n}";
+        src += " elif (beta) {\n    /* reset\n       beta */\n    beta = 0;\n} else {\n    exit(3);\n}\n";
+    }
+    return src;
+}
+
+int main(int argc, char* argv[]) {
+    const std::string src = argc > 1 ? read_file(argv[1]) : generate_program(16u << 20);
+    const int runs = 7;
+
+    size_t tokens = 0;
+    const double current = best_of(runs, [&] {
+        Tokenizer tokenizer(src);
+        tokens = 0;
+        while (tokenizer.next()) {
+            tokens++;
+        }
+    });
+
+    size_t baseline_tokens = 0;
+    const double old = best_of(runs, [&] {
+        baseline::Tokenizer tokenizer(src);
+        baseline_tokens = tokenizer.tokenize().size();
+    });
+
+    const double mb = static_cast<double>(src.size()) / 1e6;
+    std::cout << std::fixed << std::setprecision(1) << mb << " MB, " << tokens << " tokens (baseline "
+              << baseline_tokens << "), best of " << runs << "\n";
+    std::cout << "  baseline     " << mb / old << " MB/s\n";
+    std::cout << "  table-driven " << mb / current << " MB/s (" << std::setprecision(2) << old / current << "x)\n";
+    return 0;
+}
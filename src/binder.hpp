@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "interner.hpp"
+#include "parser.hpp"
+
+inline constexpr uint32_t no_slot = UINT32_MAX;
+
+// Name resolution. One walk over the parsed program gives every let its own
+// variable slot and rewrites each identifier use, let and assignment from its
+// SymbolId to the slot it refers to, so code generation never looks a name
+// up. This is also the one place undeclared and redeclared variables are
+// diagnosed.
+//
+// The current binding of each symbol lives in a table indexed by SymbolId.
+// Declaring a name saves the binding it shadows on an undo log, and leaving
+// a scope unwinds the log back to where the scope started, so resolving a
+// name is a single array access whatever the nesting depth.
+class Binder {
+    public:
+        inline Binder(NodeProgram& program, const Tokenizer& tokenizer)
+            : m_program(program), m_tokenizer(tokenizer),
+              m_bindings(Interner::global().size()) {}
+
+        // Returns false if any name failed to resolve; the program must not
+        // be generated in that case.
+        bool bind() {
+            if (m_program.root != null_node) {
+                bind_scope(m_program.root);
+            }
+            return m_ok;
+        }
+
+    private:
+        struct Binding {
+            uint32_t slot = no_slot;
+            uint32_t depth = 0;     // scope nesting depth of the declaration
+        };
+
+        struct Shadowed {
+            SymbolId symbol;
+            Binding previous;
+        };
+
+        NodeProgram& m_program;
+        const Tokenizer& m_tokenizer;
+        std::vector<Binding> m_bindings;    // indexed by SymbolId
+        std::vector<Shadowed> m_undo;
+        uint32_t m_depth = 0;
+        bool m_ok = true;
+
+        void bind_scope(NodeId scope_id) {
+            const size_t mark = m_undo.size();
+            m_depth++;
+
+            const NodeScope scope = m_program.scopes[scope_id];
+            for (NodeId id = scope.first; id < scope.first + scope.count; id++) {
+                NodeStatement& statement = m_program.statements[id];
+                switch (statement.kind) {
+                    case StmtKind::exit:
+                        bind_expr(statement.expr);
+                        break;
+                    case StmtKind::let:
+                        // The value is resolved before the new name is
+                        // visible: `let x = x;` reads the outer x
+                        bind_expr(statement.expr);
+                        statement.var = declare(statement.var, statement.ident);
+                        break;
+                    case StmtKind::assign:
+                        bind_expr(statement.expr);
+                        statement.var = resolve(statement.var, statement.ident);
+                        break;
+                    case StmtKind::if_:
+                        bind_expr(statement.expr);
+                        bind_scope(statement.scope);
+                        for (NodeId p = statement.predicate; p != null_node; p = m_program.predicates[p].next) {
+                            const NodeIfPredicate& predicate = m_program.predicates[p];
+                            bind_expr(predicate.condition);
+                            bind_scope(predicate.scope);
+                        }
+                        break;
+                    case StmtKind::scope:
+                        bind_scope(statement.scope);
+                        break;
+                }
+            }
+
+            // Names declared in this scope go out of view again
+            while (m_undo.size() > mark) {
+                const Shadowed& shadowed = m_undo.back();
+                m_bindings[shadowed.symbol] = shadowed.previous;
+                m_undo.pop_back();
+            }
+            m_depth--;
+        }
+
+        void bind_expr(ExprRange expr) {
+            for (NodeId id = expr.begin; id < expr.end; id++) {
+                NodeExpr& node = m_program.exprs[id];
+                if (node.kind == ExprKind::ident) {
+                    const SymbolId symbol = node.var();
+                    const SourceSpan span{node.lhs, static_cast<uint32_t>(Interner::global().text(symbol).size())};
+                    node.rhs = resolve(symbol, span);
+                }
+            }
+        }
+
+        uint32_t resolve(SymbolId symbol, SourceSpan span) {
+            const uint32_t slot = m_bindings[symbol].slot;
+            if (slot == no_slot) {
+                report_error("variable '" + std::string(m_program.text(span)) + "' is not declared", span);
+            }
+            return slot;
+        }
+
+        uint32_t declare(SymbolId symbol, SourceSpan span) {
+            Binding& binding = m_bindings[symbol];
+            if (binding.slot != no_slot && binding.depth == m_depth) {
+                report_error("variable '" + std::string(m_program.text(span)) + "' already declared in this scope", span);
+                return no_slot;
+            }
+            m_undo.push_back(Shadowed{symbol, binding});
+            const uint32_t slot = static_cast<uint32_t>(m_program.variables.size());
+            m_program.variables.push_back(NodeVariable{symbol, span});
+            binding = Binding{slot, m_depth};
+            return slot;
+        }
+
+        void report_error(const std::string& message, SourceSpan span) {
+            SourceLocation loc = m_tokenizer.locate(m_program.text(span));
+            std::cerr << "Error at line " << loc.line << ", column " << loc.column << ": " << message << std::endl;
+            m_ok = false;
+        }
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "dominators.hpp"
+#include "ir.hpp"
+
+// Dead code elimination on the IR.
+//
+// Each step exposes work for the next:
+//
+//   1. A branch on a constant becomes a jump to the side it takes.
+//   2. Blocks no longer reachable from the entry are deleted, along with the
+//      phi arguments they passed. Code after an exit is in such a block from
+//      the start (see IrBuilder).
+//   3. A phi whose arguments are all one value, as happens when all but one
+//      of its predecessors went, is replaced by that value.
+//   4. Instructions are marked live starting from what the program needs,
+//      the values its terminators read and stores to slots some load reads,
+//      and then everything live instructions read. The rest are deleted:
+//      variables nothing reads, the expressions computing them, and the
+//      conditions of branches steps 1 and 5 removed.
+//   5. A block holding nothing but a jump is bypassed: its predecessors go
+//      straight to its successor. A block whose only predecessor jumps to
+//      it is appended to that predecessor.
+class DeadCodeEliminator {
+    public:
+        inline explicit DeadCodeEliminator(IrProgram& program)
+            : m_program(program) {}
+
+        // Returns the number of instructions and blocks deleted
+        size_t run() {
+            fold_branches();
+            remove_unreachable_blocks();
+            remove_trivial_phis();
+            remove_dead_values();
+            if (bypass_empty_blocks()) {
+                // The conditions of the branches it dropped
+                remove_dead_values();
+            }
+            merge_blocks();
+            return m_removed;
+        }
+
+    private:
+        IrProgram& m_program;
+        size_t m_removed = 0;
+
+        void fold_branches() {
+            for (BlockId id = 0; id < m_program.blocks.size(); id++) {
+                IrBlock& block = m_program.blocks[id];
+                if (block.term != IrTerm::branch || m_program.values[block.value].op != IrOp::constant) {
+                    continue;
+                }
+                const bool taken = m_program.values[block.value].imm != 0;
+                const BlockId target = block.succs[taken ? 0 : 1];
+                remove_edge(id, block.succs[taken ? 1 : 0]);
+                block.term = IrTerm::jump;
+                block.value = no_value;
+                block.succs = {target, no_block};
+            }
+        }
+
+        // Drop `from` from the predecessors of `to`, with its phi arguments
+        void remove_edge(BlockId from, BlockId to) {
+            std::vector<BlockId>& preds = m_program.blocks[to].preds;
+            for (size_t i = preds.size(); i-- > 0;) {
+                if (preds[i] == from) {
+                    remove_pred(to, i);
+                }
+            }
+        }
+
+        void remove_pred(BlockId block_id, size_t index) {
+            IrBlock& block = m_program.blocks[block_id];
+            block.preds.erase(block.preds.begin() + static_cast<std::ptrdiff_t>(index));
+            for (ValueId id : block.insts) {
+                IrInst& phi = m_program.values[id];
+                if (phi.op != IrOp::phi) {
+                    break;
+                }
+                std::span<ValueId> args = m_program.args(phi);
+                std::copy(args.begin() + static_cast<std::ptrdiff_t>(index) + 1, args.end(),
+                          args.begin() + static_cast<std::ptrdiff_t>(index));
+                phi.b--;
+            }
+        }
+
+        void remove_unreachable_blocks() {
+            const std::vector<BlockId> order = reverse_postorder(m_program);
+            std::vector<bool> reachable(m_program.blocks.size(), false);
+            for (BlockId block : order) {
+                reachable[block] = true;
+            }
+            for (BlockId block : order) {
+                const std::vector<BlockId>& preds = m_program.blocks[block].preds;
+                for (size_t i = preds.size(); i-- > 0;) {
+                    if (!reachable[preds[i]]) {
+                        remove_pred(block, i);
+                    }
+                }
+            }
+            for (BlockId block = 0; block < m_program.blocks.size(); block++) {
+                if (!reachable[block]) {
+                    delete_block(block);
+                }
+            }
+        }
+
+        void delete_block(BlockId block_id) {
+            IrBlock& block = m_program.blocks[block_id];
+            for (ValueId id : block.insts) {
+                m_program.values[id].op = IrOp::nop;
+            }
+            // Deleted blocks are unreachable too
+            if (block.term != IrTerm::none) {
+                m_removed += block.insts.size() + 1;
+            }
+            block = IrBlock{};
+        }
+
+        // A block with no instructions that jumps to `target` can hand its
+        // predecessors over, unless `target` has phis: then the arguments
+        // it passes must go with exactly one predecessor, one that does
+        // not reach `target` already. Returns whether a branch was left
+        // with one way to go and became a jump.
+        bool bypass_empty_blocks() {
+            bool dropped_branch = false;
+            for (BlockId id = 0; id < m_program.blocks.size(); id++) {
+                IrBlock& block = m_program.blocks[id];
+                if (id == m_program.entry || block.term != IrTerm::jump || !block.insts.empty() ||
+                    block.succs[0] == id) {
+                    continue;
+                }
+                const BlockId target = block.succs[0];
+                std::vector<BlockId>& target_preds = m_program.blocks[target].preds;
+                if (starts_with_phi(target) && (block.preds.size() != 1 ||
+                                 std::find(target_preds.begin(), target_preds.end(), block.preds[0]) != target_preds.end())) {
+                    continue;
+                }
+
+                // Same position among the target's preds, so phi arguments
+                // still line up
+                auto slot = std::find(target_preds.begin(), target_preds.end(), id);
+                *slot = block.preds[0];
+                target_preds.insert(target_preds.end(), block.preds.begin() + 1, block.preds.end());
+                for (BlockId pred_id : block.preds) {
+                    IrBlock& pred = m_program.blocks[pred_id];
+                    for (BlockId& succ : pred.succs) {
+                        if (succ == id) {
+                            succ = target;
+                        }
+                    }
+                    // Both ways to the same block: no choice left to make
+                    if (pred.term == IrTerm::branch && pred.succs[0] == pred.succs[1]) {
+                        pred.term = IrTerm::jump;
+                        pred.value = no_value;
+                        pred.succs[1] = no_block;
+                        auto duplicate = std::find(target_preds.begin(), target_preds.end(), pred_id);
+                        target_preds.erase(std::find(duplicate + 1, target_preds.end(), pred_id));
+                        dropped_branch = true;
+                    }
+                }
+                delete_block(id);
+            }
+            return dropped_branch;
+        }
+
+        void merge_blocks() {
+            for (BlockId id : reverse_postorder(m_program)) {
+                IrBlock& block = m_program.blocks[id];
+                if (block.preds.size() != 1 || starts_with_phi(id)) {
+                    continue;
+                }
+                const BlockId pred_id = block.preds[0];
+                IrBlock& pred = m_program.blocks[pred_id];
+                if (pred.term != IrTerm::jump) {
+                    continue;
+                }
+                for (ValueId inst : block.insts) {
+                    m_program.values[inst].block = pred_id;
+                }
+                pred.insts.insert(pred.insts.end(), block.insts.begin(), block.insts.end());
+                pred.term = block.term;
+                pred.value = block.value;
+                pred.succs = block.succs;
+                for (BlockId succ : block.successors()) {
+                    std::vector<BlockId>& preds = m_program.blocks[succ].preds;
+                    std::replace(preds.begin(), preds.end(), id, pred_id);
+                }
+                block = IrBlock{};
+                m_removed++;
+            }
+        }
+
+        bool starts_with_phi(BlockId block) const {
+            const std::vector<ValueId>& insts = m_program.blocks[block].insts;
+            return !insts.empty() && m_program.values[insts.front()].op == IrOp::phi;
+        }
+
+        void remove_trivial_phis() {
+            std::vector<ValueId> replacement(m_program.values.size(), no_value);
+            auto resolve = [&](ValueId id) {
+                while (replacement[id] != no_value) {
+                    id = replacement[id];
+                }
+                return id;
+            };
+            // Reverse postorder sees every phi argument's definition first
+            const std::vector<BlockId> order = reverse_postorder(m_program);
+            bool replaced = false;
+            for (BlockId block : order) {
+                for (ValueId id : m_program.blocks[block].insts) {
+                    const IrInst& phi = m_program.values[id];
+                    if (phi.op != IrOp::phi) {
+                        break;
+                    }
+                    ValueId same = no_value;
+                    bool trivial = true;
+                    for (ValueId arg : m_program.args(phi)) {
+                        arg = resolve(arg);
+                        if (same != no_value && arg != same) {
+                            trivial = false;
+                            break;
+                        }
+                        same = arg;
+                    }
+                    if (trivial && same != no_value) {
+                        replacement[id] = same;
+                        replaced = true;
+                    }
+                }
+            }
+            if (!replaced) {
+                return;
+            }
+            for (BlockId block_id : order) {
+                IrBlock& block = m_program.blocks[block_id];
+                std::erase_if(block.insts, [&](ValueId id) {
+                    if (replacement[id] != no_value) {
+                        m_program.values[id].op = IrOp::nop;
+                        m_removed++;
+                        return true;
+                    }
+                    return false;
+                });
+                for (ValueId id : block.insts) {
+                    IrInst& inst = m_program.values[id];
+                    if (inst.op == IrOp::phi) {
+                        for (ValueId& arg : m_program.args(inst)) {
+                            arg = resolve(arg);
+                        }
+                    } else if (is_binary(inst.op) || inst.op == IrOp::store) {
+                        inst.a = resolve(inst.a);
+                        if (inst.b != no_value) {
+                            inst.b = resolve(inst.b);
+                        }
+                    }
+                }
+                if (block.value != no_value) {
+                    block.value = resolve(block.value);
+                }
+            }
+        }
+
+        void remove_dead_values() {
+            const std::vector<BlockId> order = reverse_postorder(m_program);
+            std::vector<bool> loaded(m_program.slot_count, false);
+            for (BlockId block : order) {
+                for (ValueId id : m_program.blocks[block].insts) {
+                    if (m_program.values[id].op == IrOp::load) {
+                        loaded[m_program.values[id].imm] = true;
+                    }
+                }
+            }
+
+            std::vector<bool> live(m_program.values.size(), false);
+            std::vector<ValueId> work;
+            auto mark = [&](ValueId id) {
+                if (!live[id]) {
+                    live[id] = true;
+                    work.push_back(id);
+                }
+            };
+            for (BlockId block_id : order) {
+                const IrBlock& block = m_program.blocks[block_id];
+                for (ValueId id : block.insts) {
+                    const IrInst& inst = m_program.values[id];
+                    if (inst.op == IrOp::store && loaded[inst.imm]) {
+                        mark(id);
+                    }
+                }
+                if (block.value != no_value) {
+                    mark(block.value);
+                }
+            }
+            while (!work.empty()) {
+                const ValueId id = work.back();
+                work.pop_back();
+                m_program.for_each_operand(m_program.values[id], mark);
+            }
+
+            for (BlockId block : order) {
+                std::erase_if(m_program.blocks[block].insts, [&](ValueId id) {
+                    if (!live[id]) {
+                        m_program.values[id].op = IrOp::nop;
+                        m_removed++;
+                        return true;
+                    }
+                    return false;
+                });
+            }
+        }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ir.hpp"
+
+// The blocks reachable from the entry in reverse postorder. The CFG is
+// acyclic, so every edge goes forward in this order. Successors are
+// visited last-first, which puts an if's arm before the code that follows
+// the branch not taken.
+inline std::vector<BlockId> reverse_postorder(const IrProgram& program) {
+    std::vector<BlockId> order;
+    std::vector<bool> visited(program.blocks.size(), false);
+    // Block, and how many of its successors are still to visit
+    std::vector<std::pair<BlockId, size_t>> stack;
+    visited[program.entry] = true;
+    stack.emplace_back(program.entry, program.blocks[program.entry].succ_count());
+    while (!stack.empty()) {
+        auto& [block, remaining] = stack.back();
+        if (remaining == 0) {
+            order.push_back(block);
+            stack.pop_back();
+            continue;
+        }
+        const BlockId succ = program.blocks[block].succs[--remaining];
+        if (!visited[succ]) {
+            visited[succ] = true;
+            stack.emplace_back(succ, program.blocks[succ].succ_count());
+        }
+    }
+    return {order.rbegin(), order.rend()};
+}
+
+// Dominator tree of the reachable blocks (Cooper, Harvey & Kennedy, "A
+// Simple, Fast Dominance Algorithm"). Blocks are numbered by their position
+// in reverse postorder, and each block's immediate dominator is the nearest
+// common ancestor of its processed predecessors, found by walking up from
+// both with the higher-numbered one first. With no loops one pass settles
+// it; the loop runs until nothing changes all the same.
+class DominatorTree {
+    public:
+        inline explicit DominatorTree(const IrProgram& program)
+            : m_program(program), m_order(reverse_postorder(program)),
+              m_index(program.blocks.size(), unreachable),
+              m_idom(program.blocks.size(), no_block),
+              m_children(program.blocks.size()) {
+            for (uint32_t i = 0; i < m_order.size(); i++) {
+                m_index[m_order[i]] = i;
+            }
+            compute_idoms();
+            number_tree();
+        }
+
+        // Reachable blocks, reverse postorder
+        const std::vector<BlockId>& order() const {
+            return m_order;
+        }
+
+        bool reachable(BlockId block) const {
+            return m_index[block] != unreachable;
+        }
+
+        // no_block for the entry and for unreachable blocks
+        BlockId idom(BlockId block) const {
+            return block == m_program.entry ? no_block : m_idom[block];
+        }
+
+        const std::vector<BlockId>& children(BlockId block) const {
+            return m_children[block];
+        }
+
+        // `a` dominates `b` (both reachable); every block dominates itself
+        bool dominates(BlockId a, BlockId b) const {
+            return m_preorder[a] <= m_preorder[b] && m_last_descendant[b] <= m_last_descendant[a];
+        }
+
+        // DF(b): the blocks where b's dominance ends, one step into a join
+        // that b does not dominate. Phis for a variable assigned in b go
+        // there.
+        std::vector<std::vector<BlockId>> frontiers() const {
+            std::vector<std::vector<BlockId>> frontier(m_program.blocks.size());
+            for (BlockId block : m_order) {
+                const std::vector<BlockId>& preds = m_program.blocks[block].preds;
+                if (preds.size() < 2) {
+                    continue;
+                }
+                for (BlockId pred : preds) {
+                    if (!reachable(pred)) {
+                        continue;
+                    }
+                    for (BlockId runner = pred; runner != m_idom[block]; runner = m_idom[runner]) {
+                        if (frontier[runner].empty() || frontier[runner].back() != block) {
+                            frontier[runner].push_back(block);
+                        }
+                    }
+                }
+            }
+            return frontier;
+        }
+
+    private:
+        static constexpr uint32_t unreachable = UINT32_MAX;
+
+        const IrProgram& m_program;
+        std::vector<BlockId> m_order;
+        std::vector<uint32_t> m_index;      // position in m_order
+        std::vector<BlockId> m_idom;        // the entry is its own
+        std::vector<std::vector<BlockId>> m_children;
+        // Dominator tree preorder numbers, and the highest one in each
+        // block's subtree
+        std::vector<uint32_t> m_preorder;
+        std::vector<uint32_t> m_last_descendant;
+
+        void compute_idoms() {
+            const BlockId entry = m_program.entry;
+            m_idom[entry] = entry;
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (size_t i = 1; i < m_order.size(); i++) {
+                    const BlockId block = m_order[i];
+                    BlockId idom = no_block;
+                    for (BlockId pred : m_program.blocks[block].preds) {
+                        if (!reachable(pred) || m_idom[pred] == no_block) {
+                            continue;
+                        }
+                        idom = idom == no_block ? pred : intersect(pred, idom);
+                    }
+                    if (m_idom[block] != idom) {
+                        m_idom[block] = idom;
+                        changed = true;
+                    }
+                }
+            }
+            for (size_t i = 1; i < m_order.size(); i++) {
+                m_children[m_idom[m_order[i]]].push_back(m_order[i]);
+            }
+        }
+
+        BlockId intersect(BlockId a, BlockId b) const {
+            while (a != b) {
+                while (m_index[a] > m_index[b]) {
+                    a = m_idom[a];
+                }
+                while (m_index[b] > m_index[a]) {
+                    b = m_idom[b];
+                }
+            }
+            return a;
+        }
+
+        // The tree can be as deep as the if nesting, so no recursion
+        void number_tree() {
+            m_preorder.assign(m_program.blocks.size(), 0);
+            m_last_descendant.assign(m_program.blocks.size(), 0);
+            uint32_t counter = 0;
+            std::vector<std::pair<BlockId, size_t>> stack;    // block, next child
+            stack.emplace_back(m_program.entry, 0);
+            m_preorder[m_program.entry] = counter++;
+            while (!stack.empty()) {
+                auto& [block, next] = stack.back();
+                if (next == m_children[block].size()) {
+                    m_last_descendant[block] = counter - 1;
+                    stack.pop_back();
+                    continue;
+                }
+                const BlockId child = m_children[block][next++];
+                m_preorder[child] = counter++;
+                stack.emplace_back(child, 0);
+            }
+        }
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Append-only assembly text buffer. Every piece of output is written straight
+// into one growable string, numbers are formatted in place with to_chars, and
+// nothing is built up in temporaries and copied upwards, so emitting a
+// program costs time proportional to the size of the output whatever the
+// nesting depth of the source.
+class Emitter {
+    public:
+        explicit Emitter(size_t reserve = 1 << 16) {
+            m_buffer.reserve(reserve);
+        }
+
+        // emit("\tldr\tw0, [sp, #", offset, "]\n") appends each piece in turn:
+        // text as is, integers in decimal
+        template <typename... Pieces>
+        void emit(const Pieces&... pieces) {
+            (append(pieces), ...);
+        }
+
+        // A local label reference, `.L<n>`
+        struct Label {
+            size_t number;
+        };
+
+        // A 32-bit general purpose register, `w<n>`
+        struct Reg {
+            uint8_t number;
+        };
+
+        std::string_view view() const {
+            return m_buffer;
+        }
+
+        size_t size() const {
+            return m_buffer.size();
+        }
+
+    private:
+        std::string m_buffer;
+
+        void append(std::string_view text) {
+            m_buffer.append(text);
+        }
+
+        void append(const char* text) {
+            m_buffer.append(text);
+        }
+
+        void append(char c) {
+            m_buffer.push_back(c);
+        }
+
+        template <std::integral Int>
+        void append(Int value) {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            m_buffer.append(digits, result.ptr);
+        }
+
+        void append(const Reg& reg) {
+            append('w');
+            append(static_cast<unsigned>(reg.number));
+        }
+
+        void append(const Label& label) {
+            append(".L");
+            append(label.number);
+        }
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+// Constant folding and algebraic simplification over the bound program.
+//
+// Expressions are post-order, so one forward pass over each expression sees
+// both operands of a node already simplified. A binary node whose operands
+// are both literals becomes a literal, computed with the target's 32-bit
+// semantics (wrapping add/sub/mul, unsigned division as udiv does it), and
+// identities that do not depend on the other operand's value are applied:
+//
+//     x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1   ->  x
+//     x * 0, 0 * x, x - x, 0 / x                 ->  0
+//     x == x, x <= x, x >= x, x >= 0, 0 <= x     ->  1
+//     x != x, x < x, x > x, x < 0, 0 > x         ->  0
+//
+// (0 / x is 0 even for x = 0, since udiv by zero yields 0, and comparisons
+// are unsigned, so nothing is below 0.) Replacing a node
+// copies the surviving operand into its place; the expression is then
+// compacted so that it again holds only the nodes its root reaches.
+// Dividing by a constant zero is reported instead of being folded.
+class ConstantFolder {
+    public:
+        inline ConstantFolder(NodeProgram& program, const Tokenizer& tokenizer)
+            : m_program(program), m_tokenizer(tokenizer) {}
+
+        // Returns false if a division by constant zero was found
+        bool fold() {
+            for (NodeStatement& statement : m_program.statements) {
+                if (!statement.expr.empty()) {
+                    statement.expr = fold_expr(statement.expr);
+                }
+            }
+            for (NodeIfPredicate& predicate : m_program.predicates) {
+                if (!predicate.is_else()) {
+                    predicate.condition = fold_expr(predicate.condition);
+                }
+            }
+            return m_ok;
+        }
+
+    private:
+        NodeProgram& m_program;
+        const Tokenizer& m_tokenizer;
+        std::vector<bool> m_live;
+        std::vector<NodeId> m_remap;
+        bool m_ok = true;
+
+        ExprRange fold_expr(ExprRange expr) {
+            bool changed = false;
+            for (NodeId id = expr.begin; id < expr.end; id++) {
+                if (!m_program.exprs[id].is_leaf()) {
+                    changed |= simplify(m_program.exprs[id]);
+                }
+            }
+            return changed ? compact(expr) : expr;
+        }
+
+        bool simplify(NodeExpr& node) {
+            const NodeExpr lhs = m_program.exprs[node.lhs];
+            const NodeExpr rhs = m_program.exprs[node.rhs];
+            const bool lhs_const = lhs.kind == ExprKind::int_lit;
+            const bool rhs_const = rhs.kind == ExprKind::int_lit;
+
+            if (node.kind == ExprKind::div && rhs_const && rhs.value() == 0) {
+                report_error("division by constant zero", rhs.lhs);
+                return false;
+            }
+            if (lhs_const && rhs_const) {
+                node = NodeExpr::constant(lhs.lhs, evaluate(node.kind, lhs.value(), rhs.value()));
+                return true;
+            }
+
+            switch (node.kind) {
+                case ExprKind::add:
+                    if (rhs_const && rhs.value() == 0) {
+                        node = lhs;
+                        return true;
+                    }
+                    if (lhs_const && lhs.value() == 0) {
+                        node = rhs;
+                        return true;
+                    }
+                    break;
+                case ExprKind::sub:
+                    if (rhs_const && rhs.value() == 0) {
+                        node = lhs;
+                        return true;
+                    }
+                    if (lhs.kind == ExprKind::ident && rhs.kind == ExprKind::ident && lhs.var() == rhs.var()) {
+                        node = NodeExpr::constant(lhs.lhs, 0);
+                        return true;
+                    }
+                    break;
+                case ExprKind::mul:
+                    if (rhs_const && rhs.value() == 1) {
+                        node = lhs;
+                        return true;
+                    }
+                    if (lhs_const && lhs.value() == 1) {
+                        node = rhs;
+                        return true;
+                    }
+                    if (rhs_const && rhs.value() == 0) {
+                        node = rhs;
+                        return true;
+                    }
+                    if (lhs_const && lhs.value() == 0) {
+                        node = lhs;
+                        return true;
+                    }
+                    break;
+                case ExprKind::div:
+                    if (rhs_const && rhs.value() == 1) {
+                        node = lhs;
+                        return true;
+                    }
+                    if (lhs_const && lhs.value() == 0) {
+                        node = lhs;
+                        return true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            if (is_comparison(node.kind)) {
+                const bool same_var = lhs.kind == ExprKind::ident && rhs.kind == ExprKind::ident && lhs.var() == rhs.var();
+                // Result of comparing a value with itself, or with zero
+                // from the side where the answer is the same for all values
+                int known = -1;
+                if (same_var) {
+                    known = evaluate(node.kind, 0, 0);
+                } else if ((node.kind == ExprKind::ge && rhs_const && rhs.value() == 0) ||
+                           (node.kind == ExprKind::le && lhs_const && lhs.value() == 0)) {
+                    known = 1;
+                } else if ((node.kind == ExprKind::lt && rhs_const && rhs.value() == 0) ||
+                           (node.kind == ExprKind::gt && lhs_const && lhs.value() == 0)) {
+                    known = 0;
+                }
+                if (known >= 0) {
+                    node = NodeExpr::constant(lhs_const ? lhs.lhs : rhs.lhs, static_cast<uint32_t>(known));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static uint32_t evaluate(ExprKind kind, uint32_t lhs, uint32_t rhs) {
+            switch (kind) {
+                case ExprKind::add:
+                    return lhs + rhs;
+                case ExprKind::sub:
+                    return lhs - rhs;
+                case ExprKind::mul:
+                    return lhs * rhs;
+                case ExprKind::div:
+                    return rhs == 0 ? 0 : lhs / rhs;
+                case ExprKind::eq:
+                    return lhs == rhs;
+                case ExprKind::ne:
+                    return lhs != rhs;
+                case ExprKind::lt:
+                    return lhs < rhs;
+                case ExprKind::le:
+                    return lhs <= rhs;
+                case ExprKind::gt:
+                    return lhs > rhs;
+                case ExprKind::ge:
+                    return lhs >= rhs;
+                default:
+                    return 0;
+            }
+        }
+
+        // Drop the nodes the root no longer reaches, keeping post-order
+        ExprRange compact(ExprRange expr) {
+            const NodeId begin = expr.begin;
+            const size_t count = expr.end - expr.begin;
+            m_live.assign(count, false);
+            m_remap.resize(count);
+            m_live[count - 1] = true;
+            for (size_t i = count; i-- > 0;) {
+                const NodeExpr& node = m_program.exprs[begin + i];
+                if (m_live[i] && !node.is_leaf()) {
+                    m_live[node.lhs - begin] = true;
+                    m_live[node.rhs - begin] = true;
+                }
+            }
+
+            NodeId out = begin;
+            for (size_t i = 0; i < count; i++) {
+                if (!m_live[i]) {
+                    continue;
+                }
+                NodeExpr node = m_program.exprs[begin + i];
+                if (!node.is_leaf()) {
+                    node.lhs = m_remap[node.lhs - begin];
+                    node.rhs = m_remap[node.rhs - begin];
+                }
+                m_remap[i] = out;
+                m_program.exprs[out++] = node;
+            }
+            return ExprRange{begin, out};
+        }
+
+        void report_error(const std::string& message, uint32_t offset) {
+            SourceLocation loc = m_tokenizer.locate(m_program.source.substr(offset, 0));
+            std::cerr << "Error at line " << loc.line << ", column " << loc.column << ": " << message << std::endl;
+            m_ok = false;
+        }
+};
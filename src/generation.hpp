@@ -1,339 +1,742 @@
 #pragma once
-#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
 #include <vector>
-#include <variant>
-#include <unordered_map> // Corrected typo
-#include <map>
-#include <iostream> // For std::cerr
-#include "parser.hpp" // Assuming parser.hpp defines NodeProgram, NodeStatement, NodeExpr etc.
+#include "dominators.hpp"
+#include "instructions.hpp"
+#include "ir.hpp"
+#include "regalloc.hpp"
+#include "strength.hpp"
 
 
+// Lowers the IR to AArch64 instructions.
+//
+// The IR is first prepared in place. Critical edges into blocks with phis
+// are split, so that every predecessor of such a block has it as its only
+// successor and the phi moves can go at the predecessor's end. A comparison
+// that only its block's branch reads is moved to the end of the block, so
+// that the branch can test the flags it sets and the 0/1 value never needs
+// a register. Blocks are then laid out in reverse postorder, values get
+// registers or stack cells from RegisterAllocator, and each instruction is
+// selected on its own:
+//
+//   - constants become the immediates of add/sub/cmp where they fit; one
+//     read from a register gets one, like any other value, but is loaded
+//     again where it is read rather than spilled
+//   - multiplications and divisions by constants are strength reduced where
+//     `costs` says that is cheaper than mul/udiv
+//   - a branch on x == 0 or x != 0 tests x with cbz/cbnz
+//
+// The frame is laid out before any code is generated and reserved with a
+// single `sub sp` on entry, so sp never moves afterwards and every cell is
+// at a fixed offset from it:
+//
+//     [sp, #0] ...          variable slots still in memory, shared by slots
+//                           whose lifetimes don't overlap
+//     [sp, #slot_area] ...  spilled values, by stack cell
 class Generator {
     public:
-        inline explicit Generator(const NodeProgram program )
-            : m_program(std::move(program)) {
-            // Initialize with global scope
-            m_scope_stack.push_back({});
+        inline Generator(IrProgram& program, const CostModel& costs = apple_m1,
+                         size_t register_count = RegisterAllocator::pool.size())
+            : m_program(program), m_costs(costs), m_register_count(register_count) {}
+
+        // The body of _main, for write_program() to print once later
+        // passes are done with it
+        std::vector<Instr> generate_program() {
+            split_critical_edges();
+            sink_conditions();
+            fold_constants();
+            m_layout = reverse_postorder(m_program);
+            m_registers = RegisterAllocator(m_program, m_layout, m_folded, m_register_count).allocate();
+            assign_slot_cells();
+
+            m_code.push_back(Instr{});     // the prologue, once the frame size is known
+            for (size_t i = 0; i < m_layout.size(); i++) {
+                const BlockId block = m_layout[i];
+                if (i != 0) {
+                    m_code.push_back(Instr::label(block));
+                }
+                for (ValueId id : m_program.blocks[block].insts) {
+                    generate_value(id);
+                }
+                generate_terminator(block, i + 1 < m_layout.size() ? m_layout[i + 1] : no_block);
+            }
+
+            // sp must stay 16-byte aligned
+            const uint32_t frame_size = ((m_slot_cells + m_registers.cell_count) * slot_size + 15) & ~15u;
+            if (frame_size != 0) {
+                m_code.front() = Instr::frame(frame_size);
+            }
+            return std::move(m_code);
         }
 
-        std::string generate_expr(const NodeExpr& expr) {
-            std::string code;
-            if (std::holds_alternative<NodeExprIntLit>(expr.var)) {
-                const auto& int_lit = std::get<NodeExprIntLit>(expr.var).int_lit;
-                code += "\tmov\tw0, #" + int_lit.value + "\n";
-                code += "\tstr\tw0, [sp, #-16]!\n"; // Push to stack
-                m_stack_size += 16;
-            } else if (std::holds_alternative<NodeExprIdent>(expr.var)) {
-                const auto& ident_expr = std::get<NodeExprIdent>(expr.var);
-                const std::string& ident_name = ident_expr.ident.value;
-                auto var_opt = find_in_any_scope(ident_name);
-                if (var_opt) {
-                    size_t var_stack_pos = var_opt->stack_offset;
-                    size_t offset_from_current_sp = m_stack_size - var_stack_pos - 16;
-                    code += "\tldr\tw0, [sp, #" + std::to_string(offset_from_current_sp) + "]\n";
-                    code += "\tstr\tw0, [sp, #-16]!\n"; // Push to stack
-                    m_stack_size += 16;
-                } else {
-                    std::cerr << "Error: Undeclared variable '" << ident_name << "' used in expression.\n";
-                    code += "\tmov\tw0, #0\n";
-                    code += "\tstr\tw0, [sp, #-16]!\n"; // Push default value
-                    m_stack_size += 16;
-                }
-            } else if (std::holds_alternative<BinExpr>(expr.var)) {
-                const auto& bin_expr = std::get<BinExpr>(expr.var);
-                if (std::holds_alternative<BinExprAdd>(bin_expr.var)) {
-                    const auto& add_expr = std::get<BinExprAdd>(bin_expr.var);
-                    // Generate code for left operand (pushes to stack)
-                    code += generate_expr(*add_expr.left);
-                    // Generate code for right operand (pushes to stack)  
-                    code += generate_expr(*add_expr.right);
-                    // Pop both operands and add them
-                    code += "\tldr\tw1, [sp], #16\n";  // Pop right operand to w1
-                    code += "\tldr\tw0, [sp], #16\n";  // Pop left operand to w0
-                    code += "\tadd\tw0, w0, w1\n";     // Add them
-                    code += "\tstr\tw0, [sp, #-16]!\n"; // Push result back
-                    m_stack_size -= 16; // Net effect: two pops, one push = -16
-                } else if (std::holds_alternative<BinExprMul>(bin_expr.var)) {
-                    const auto& mul_expr = std::get<BinExprMul>(bin_expr.var);
-                    // Generate code for left operand (pushes to stack)
-                    code += generate_expr(*mul_expr.left);
-                    // Generate code for right operand (pushes to stack)
-                    code += generate_expr(*mul_expr.right);
-                    // Pop both operands and multiply them
-                    code += "\tldr\tw1, [sp], #16\n";  // Pop right operand to w1
-                    code += "\tldr\tw0, [sp], #16\n";  // Pop left operand to w0
-                    code += "\tmul\tw0, w0, w1\n";     // Multiply them
-                    code += "\tstr\tw0, [sp, #-16]!\n"; // Push result back
-                    m_stack_size -= 16; // Net effect: two pops, one push = -16
-                } else if (std::holds_alternative<BinExprDiv>(bin_expr.var)) {
-                    const auto& div_expr = std::get<BinExprDiv>(bin_expr.var);
-                    // Generate code for left operand (pushes to stack)
-                    code += generate_expr(*div_expr.left);
-                    // Generate code for right operand (pushes to stack)
-                    code += generate_expr(*div_expr.right);
-                    // Pop both operands and divide them
-                    code += "\tldr\tw1, [sp], #16\n";  // Pop right operand to w1
-                    code += "\tldr\tw0, [sp], #16\n";  // Pop left operand to w0
-                    code += "\tudiv\tw0, w0, w1\n";    // Divide them
-                    code += "\tstr\tw0, [sp, #-16]!\n"; // Push result back
-                    m_stack_size -= 16; // Net effect: two pops, one push = -16
-                } else if (std::holds_alternative<BinExprSub>(bin_expr.var)) {
-                    const auto& sub_expr = std::get<BinExprSub>(bin_expr.var);
-                    // Generate code for left operand (pushes to stack)
-                    code += generate_expr(*sub_expr.left);
-                    // Generate code for right operand (pushes to stack)
-                    code += generate_expr(*sub_expr.right);
-                    // Pop both operands and subtract them
-                    code += "\tldr\tw1, [sp], #16\n";  // Pop right operand to w1
-                    code += "\tldr\tw0, [sp], #16\n";  // Pop left operand to w0
-                    code += "\tsub\tw0, w0, w1\n";     // Subtract them (left - right)
-                    code += "\tstr\tw0, [sp, #-16]!\n"; // Push result back
-                    m_stack_size -= 16; // Net effect: two pops, one push = -16
-                }
-            }
-            return code;
+    private:
+        IrProgram& m_program;
+        const CostModel& m_costs;
+        size_t m_register_count;
+        std::vector<Instr> m_code;
+        std::vector<BlockId> m_layout;
+        RegisterAssignment m_registers;
+        // Values folded into the instructions that read them: comparisons
+        // emitted by their block's branch, and constants used as immediates
+        std::vector<bool> m_folded;
+
+        // Scratch registers, never allocated (see RegisterAllocator): the
+        // first for operands that are not in a register and for results
+        // that go to a cell, the second for a second operand, magic numbers
+        // and breaking cycles of phi moves
+        static constexpr uint8_t scratch = 9;
+        static constexpr uint8_t scratch2 = 10;
+
+        // Values are 32-bit, so a cell is 4 bytes
+        static constexpr uint32_t slot_size = 4;
+        std::vector<uint32_t> m_slot_cell;      // by variable slot
+        uint32_t m_slot_cells = 0;
+
+        uint32_t slot_offset(uint32_t slot) const {
+            return m_slot_cell[slot] * slot_size;
+        }
+
+        uint32_t spill_offset(ValueId value) const {
+            return (m_slot_cells + m_registers.cells[value]) * slot_size;
         }
 
-        std::string generate_exit(const NodeExpr& exit_expr) {
-            std::string code;
-            code += "\t# Exit\n";
-            if (std::holds_alternative<NodeExprIntLit>(exit_expr.var)) {
-                const auto& int_lit = std::get<NodeExprIntLit>(exit_expr.var).int_lit;
-                code += "\tmov\tw0, #" + int_lit.value + "\n";
-            } else if (std::holds_alternative<NodeExprIdent>(exit_expr.var)) {
-                const auto& ident_expr = std::get<NodeExprIdent>(exit_expr.var);
-                const std::string& ident_name = ident_expr.ident.value;
-                auto var_opt = find_in_any_scope(ident_name);
-                if (var_opt) {
-                    size_t var_stack_pos = var_opt->stack_offset;
-                    size_t offset_from_current_sp = m_stack_size - var_stack_pos - 16;
-                    code += "\tldr\tw0, [sp, #" + std::to_string(offset_from_current_sp) + "]\n";
+        // Give every block ending in a branch to a block with phis a block
+        // of its own on that edge, ending in a jump
+        void split_critical_edges() {
+            const size_t block_count = m_program.blocks.size();
+            for (BlockId from = 0; from < block_count; from++) {
+                if (m_program.blocks[from].term != IrTerm::branch) {
+                    continue;
+                }
+                for (size_t k = 0; k < 2; k++) {
+                    const BlockId to = m_program.blocks[from].succs[k];
+                    if (!starts_with_phi(to)) {
+                        continue;
+                    }
+                    const BlockId edge = m_program.add_block();
+                    IrBlock& block = m_program.blocks[edge];
+                    block.preds.push_back(from);
+                    block.term = IrTerm::jump;
+                    block.succs[0] = to;
+                    // Same position among the preds, so phi arguments still line up
+                    std::vector<BlockId>& preds = m_program.blocks[to].preds;
+                    *std::find(preds.begin(), preds.end(), from) = edge;
+                    m_program.blocks[from].succs[k] = edge;
+                }
+            }
+        }
+
+        bool starts_with_phi(BlockId block) const {
+            const std::vector<ValueId>& insts = m_program.blocks[block].insts;
+            return !insts.empty() && m_program.values[insts.front()].op == IrOp::phi;
+        }
+
+        void sink_conditions() {
+            std::vector<uint32_t> uses(m_program.values.size(), 0);
+            for (const IrBlock& block : m_program.blocks) {
+                for (ValueId id : block.insts) {
+                    m_program.for_each_operand(m_program.values[id], [&](ValueId operand) {
+                        uses[operand]++;
+                    });
+                }
+                if (block.value != no_value) {
+                    uses[block.value]++;
+                }
+            }
+
+            m_folded.assign(m_program.values.size(), false);
+            for (BlockId id = 0; id < m_program.blocks.size(); id++) {
+                IrBlock& block = m_program.blocks[id];
+                if (block.term != IrTerm::branch) {
+                    continue;
+                }
+                const IrInst& condition = m_program.values[block.value];
+                if (!is_comparison(condition.op) || condition.block != id || uses[block.value] != 1) {
+                    continue;
+                }
+                auto position = std::find(block.insts.begin(), block.insts.end(), block.value);
+                std::rotate(position, position + 1, block.insts.end());
+                m_folded[block.value] = true;
+            }
+        }
+
+        // Constants that no instruction reads from a register need none:
+        // they are immediates, or moved straight into a phi or w0
+        void fold_constants() {
+            std::vector<bool> in_register(m_program.values.size(), false);
+            for (const IrBlock& block : m_program.blocks) {
+                for (ValueId id : block.insts) {
+                    for_each_fetched(id, [&](ValueId operand) {
+                        in_register[operand] = true;
+                    });
+                }
+            }
+            for (ValueId id = 0; id < m_program.values.size(); id++) {
+                if (m_program.values[id].op == IrOp::constant && !in_register[id]) {
+                    m_folded[id] = true;
+                }
+            }
+        }
+
+        // Call f(operand) for each operand of `id` that is read from a
+        // register, as generate_value() or generate_branch() reads them
+        template <typename F>
+        void for_each_fetched(ValueId id, F&& f) const {
+            const IrInst& inst = m_program.values[id];
+            if (inst.op == IrOp::store) {
+                f(inst.a);
+                return;
+            }
+            if (!is_binary(inst.op)) {
+                return;
+            }
+            if (m_folded[id]) {
+                if (const ValueId operand = zero_compared(inst); operand != no_value) {
+                    f(operand);
+                    return;
+                }
+            }
+            if (plan_reduction(inst).kind != Reduction::Kind::none) {
+                f(reduced_operand(inst));
+            } else if (const ImmediateForm form = plan_immediate(inst); form.op != Opcode::nop) {
+                f(form.operand);
+            } else {
+                f(inst.a);
+                f(inst.b);
+            }
+        }
+
+        // Variables still in memory get cells by the scan that gives spilled
+        // values theirs (RegisterAllocator::assign_cells). A slot lives from
+        // its first access to its last in layout order; the CFG is acyclic
+        // and laid out in reverse postorder, so every path from one access
+        // to a later one stays inside that range. Once the scan is past a
+        // slot's last access its cell is free again, and the variables of
+        // sibling scopes share cells.
+        void assign_slot_cells() {
+            auto for_each_access = [this](auto&& f) {
+                uint32_t point = 0;
+                for (BlockId block : m_layout) {
+                    for (ValueId id : m_program.blocks[block].insts) {
+                        const IrInst& inst = m_program.values[id];
+                        if (inst.op == IrOp::load || inst.op == IrOp::store) {
+                            f(inst.imm, point);
+                        }
+                        point++;
+                    }
+                }
+            };
+            std::vector<uint32_t> last_access(m_program.slot_count, 0);
+            for_each_access([&](uint32_t slot, uint32_t point) { last_access[slot] = point; });
+
+            m_slot_cell.assign(m_program.slot_count, no_cell);
+            using Active = std::pair<uint32_t, uint32_t>;   // last access, cell
+            std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+            std::vector<uint32_t> free;
+            for_each_access([&](uint32_t slot, uint32_t point) {
+                if (m_slot_cell[slot] != no_cell) {
+                    return;
+                }
+                while (!active.empty() && active.top().first < point) {
+                    free.push_back(active.top().second);
+                    active.pop();
+                }
+                if (!free.empty()) {
+                    m_slot_cell[slot] = free.back();
+                    free.pop_back();
                 } else {
-                    std::cerr << "Error: Undeclared variable '" << ident_name << "' used in exit statement.\n";
-                    code += "\tmov\tw0, #0\n";
-                }
-            } else if (std::holds_alternative<BinExpr>(exit_expr.var)) {
-                size_t old_stack_size = m_stack_size;
-                code += generate_expr(exit_expr);
-                code += "\tldr\tw0, [sp], #16\n"; // Pop result for exit
-                m_stack_size = old_stack_size; // Restore stack size
-            }
-            code += "\tmov\tx16, #1\n"; // syscall for exit
-            code += "\tsvc\t#0x80\n";   // make the syscall
-            return code;
+                    m_slot_cell[slot] = m_slot_cells++;
+                }
+                active.emplace(last_access[slot], m_slot_cell[slot]);
+            });
+        }
+
+        void generate_value(ValueId id) {
+            const IrInst& inst = m_program.values[id];
+            switch (inst.op) {
+                case IrOp::load: {
+                    const uint8_t dst = target(id);
+                    m_code.push_back(Instr::memory(Opcode::ldr, dst, slot_offset(inst.imm)));
+                    finish(id, dst);
+                    break;
+                }
+                case IrOp::store:
+                    m_code.push_back(Instr::memory(Opcode::str, fetch(inst.a, scratch), slot_offset(inst.imm)));
+                    break;
+                case IrOp::constant:
+                    if (m_registers.in_register(id)) {
+                        load_constant(m_registers.registers[id], inst.imm);
+                    }
+                    break;
+                default:
+                    if (is_binary(inst.op) && !m_folded[id]) {
+                        generate_binary(id, inst);
+                    }
+                    // Phis are filled in by their predecessors
+                    break;
+            }
         }
 
-        std::string generate_let(const NodeStatementLet& let_stmt) {
-            std::string code;
-            const std::string& ident = let_stmt.ident.value;
-            
-            if (find_in_current_scope(ident)) {
-                std::cerr << "Error: Variable '" << ident << "' already declared in current scope.\n";
-                return code;
-            }
-
-            if (std::holds_alternative<NodeExprIntLit>(let_stmt.value.var)) {
-                const auto& int_lit = std::get<NodeExprIntLit>(let_stmt.value.var).int_lit;
-                code += "\tmov\tw1, #" + int_lit.value + "\n";
-                code += "\tstr\tw1, [sp, #-16]!\n";
-                m_scope_stack.back()[ident] = Var{m_stack_size};
-                m_stack_size += 16;
-            } else if (std::holds_alternative<NodeExprIdent>(let_stmt.value.var)) {
-                const auto& ident_expr = std::get<NodeExprIdent>(let_stmt.value.var);
-                const std::string& source_ident = ident_expr.ident.value;
-                auto var_opt = find_in_any_scope(source_ident);
-                if (var_opt) {
-                    size_t source_stack_pos = var_opt->stack_offset;
-                    size_t source_offset_from_sp = m_stack_size - source_stack_pos - 16;
-                    code += "\tldr\tw1, [sp, #" + std::to_string(source_offset_from_sp) + "]\n";
-                    code += "\tstr\tw1, [sp, #-16]!\n";
-                    m_scope_stack.back()[ident] = Var{m_stack_size};
-                    m_stack_size += 16;
+        void generate_binary(ValueId id, const IrInst& inst) {
+            if (const Reduction reduction = plan_reduction(inst); reduction.kind != Reduction::Kind::none) {
+                const uint8_t source = fetch(reduced_operand(inst), scratch);
+                const uint8_t dst = target(id);
+                generate_reduction(reduction, source, dst);
+                finish(id, dst);
+                return;
+            }
+            if (const ImmediateForm form = plan_immediate(inst); form.op != Opcode::nop) {
+                const uint8_t source = fetch(form.operand, scratch);
+                const uint8_t dst = target(id);
+                if (form.op == Opcode::cmp) {
+                    m_code.push_back(Instr::cmp_imm(source, form.imm));
+                    m_code.push_back(Instr::cset(dst, form.cond));
                 } else {
-                    std::cerr << "Error: Undeclared variable '" << source_ident << "' used in let statement.\n";
+                    m_code.push_back(Instr::binary_imm(form.op, dst, source, form.imm));
                 }
-            } else if (std::holds_alternative<BinExpr>(let_stmt.value.var)) {
-                size_t old_stack_size = m_stack_size;
-                code += generate_expr(let_stmt.value);
-                m_scope_stack.back()[ident] = Var{old_stack_size};
+                finish(id, dst);
+                return;
+            }
+            const uint8_t lhs = fetch(inst.a, scratch);
+            const uint8_t rhs = fetch(inst.b, scratch2);
+            const uint8_t dst = target(id);
+            if (is_comparison(inst.op)) {
+                m_code.push_back(Instr::binary(Opcode::cmp, no_register, lhs, rhs));
+                m_code.push_back(Instr::cset(dst, condition_code(inst.op)));
+            } else {
+                m_code.push_back(Instr::binary(machine_op(inst.op), dst, lhs, rhs));
+            }
+            finish(id, dst);
+        }
+
+        // The register holding `value` for an instruction to read: its own,
+        // or `into` once it has been loaded there
+        uint8_t fetch(ValueId value, uint8_t into) {
+            if (m_registers.in_register(value)) {
+                return m_registers.registers[value];
+            }
+            const IrInst& inst = m_program.values[value];
+            if (inst.op == IrOp::constant) {
+                load_constant(into, inst.imm);
+                return into;
+            }
+            if (m_registers.in_cell(value)) {
+                m_code.push_back(Instr::memory(Opcode::ldr, into, spill_offset(value)));
+            }
+            return into;    // undef: whatever is there
+        }
+
+        // The register to compute `value` in; finish() stores it to the
+        // value's cell if it has no register of its own
+        uint8_t target(ValueId value) const {
+            return m_registers.in_register(value) ? m_registers.registers[value] : scratch;
+        }
+
+        void finish(ValueId value, uint8_t reg) {
+            if (!m_registers.in_register(value)) {
+                m_code.push_back(Instr::memory(Opcode::str, reg, spill_offset(value)));
+            }
+        }
+
+        // `value` into register `dst`
+        void materialize(uint8_t dst, ValueId value) {
+            const uint8_t reg = fetch(value, dst);
+            if (reg != dst) {
+                m_code.push_back(Instr::mov(dst, reg));
             }
-            return code;
         }
 
-        std::string generate_if(const NodeStatementIf& if_stmt) {
-            std::string code;
-            size_t current_label = m_label_counter++;
-            
-            code += "\t# If\n";
-            size_t old_stack_size = m_stack_size;
-            code += generate_expr(if_stmt.condition);
-            
-            code += "\tldr\tw0, [sp], #16\n";
-            m_stack_size = old_stack_size;
-            
-            code += "\tcmp\tw0, #0\n";
-            const std::string skip_label = ".L" + std::to_string(current_label) + "_skip";
-            code += "\tb.eq\t" + skip_label + "\n";
-            
-            code += generate_scope(if_stmt.then_scope);
-            
-            if (if_stmt.predicate) {
-                const std::string end_label = ".L" + std::to_string(current_label) + "_end";
-                code += "\tb\t" + end_label + "\n";
-                code += skip_label + ":\n";
-                code += generate_predicate(*if_stmt.predicate, end_label);
-                code += end_label + ":\n";
+        void generate_terminator(BlockId id, BlockId next) {
+            const IrBlock& block = m_program.blocks[id];
+            switch (block.term) {
+                case IrTerm::jump:
+                    generate_phi_moves(id, block.succs[0]);
+                    if (block.succs[0] != next) {
+                        m_code.push_back(Instr::branch(block.succs[0]));
+                    }
+                    break;
+                case IrTerm::branch:
+                    generate_branch(block, next);
+                    break;
+                case IrTerm::exit:
+                    materialize(0, block.value);
+                    m_code.push_back(Instr::exit());
+                    break;
+                case IrTerm::none:
+                    break;
+            }
+        }
+
+        // Branch to succs[0] if the condition is non-zero, else to succs[1],
+        // falling through to whichever of them comes next
+        void generate_branch(const IrBlock& block, BlockId next) {
+            const BlockId then_block = block.succs[0];
+            const BlockId else_block = block.succs[1];
+            const IrInst& condition = m_program.values[block.value];
+            if (condition.op == IrOp::constant) {
+                const BlockId taken = condition.imm != 0 ? then_block : else_block;
+                if (taken != next) {
+                    m_code.push_back(Instr::branch(taken));
+                }
+                return;
+            }
+
+            // How to branch to a block when the condition is true, or when
+            // it is false: on the flags, or on a register being zero
+            Cond cond = Cond::ne;
+            uint8_t tested = no_register;
+            bool zero_is_true = false;
+            if (!m_folded[block.value]) {
+                tested = fetch(block.value, scratch);
+            } else if (const ValueId operand = zero_compared(condition); operand != no_value) {
+                tested = fetch(operand, scratch);
+                zero_is_true = condition.op == IrOp::eq;
+            } else if (const ImmediateForm form = plan_immediate(condition); form.op == Opcode::cmp) {
+                m_code.push_back(Instr::cmp_imm(fetch(form.operand, scratch), form.imm));
+                cond = form.cond;
             } else {
-                code += skip_label + ":\n";
+                const uint8_t lhs = fetch(condition.a, scratch);
+                const uint8_t rhs = fetch(condition.b, scratch2);
+                m_code.push_back(Instr::binary(Opcode::cmp, no_register, lhs, rhs));
+                cond = condition_code(condition.op);
+            }
+            auto branch_when = [&](bool truth, BlockId target) {
+                if (tested == no_register) {
+                    m_code.push_back(Instr::branch_if(truth ? cond : invert(cond), target));
+                } else {
+                    const bool on_zero = truth == zero_is_true;
+                    m_code.push_back(Instr::branch_zero(on_zero ? Opcode::cbz : Opcode::cbnz, tested, target));
+                }
+            };
+
+            if (next == then_block) {
+                branch_when(false, else_block);
+            } else {
+                branch_when(true, then_block);
+                if (next != else_block) {
+                    m_code.push_back(Instr::branch(else_block));
+                }
             }
-            return code;
         }
 
-        std::string generate_predicate(const NodeIfPredicate& predicate, const std::string& end_label) {
-            std::string code;
-            if (std::holds_alternative<NodeIfPredicateElse>(predicate.var)) {
-                const auto& else_predicate = std::get<NodeIfPredicateElse>(predicate.var);
-                code += "\t# Else\n";
-                code += generate_scope(else_predicate.scope);
-            } else if (std::holds_alternative<NodeIfPredicateElif>(predicate.var)) {
-                const auto& elif_predicate = std::get<NodeIfPredicateElif>(predicate.var);
-                size_t current_label = m_label_counter++;
-                
-                code += "\t# Elif\n";
-                size_t old_stack_size = m_stack_size;
-                code += generate_expr(elif_predicate.condition);
-                
-                code += "\tldr\tw0, [sp], #16\n";
-                m_stack_size = old_stack_size;
-                
-                const std::string skip_label = ".L" + std::to_string(current_label) + "_skip";
-                code += "\tcmp\tw0, #0\n";
-                code += "\tb.eq\t" + skip_label + "\n";
-                
-                code += generate_scope(elif_predicate.scope);
-                
-                code += "\tb\t" + end_label + "\n";
-                code += skip_label + ":\n";
-                
-                if (elif_predicate.predicate) {
-                    code += generate_predicate(*elif_predicate.predicate, end_label);
-                }
-            }
-            return code;
+        // x for x == 0, x != 0, 0 == x and 0 != x
+        ValueId zero_compared(const IrInst& condition) const {
+            if (condition.op != IrOp::eq && condition.op != IrOp::ne) {
+                return no_value;
+            }
+            if (is_constant(condition.b, 0)) {
+                return condition.a;
+            }
+            if (is_constant(condition.a, 0)) {
+                return condition.b;
+            }
+            return no_value;
         }
 
-        std::string generate_scope(const NodeScope& scope) {
-            std::string code;
-            // Push new scope
-            m_scope_stack.push_back({});
-            
-            for (const auto& statement : scope.statements) {
-                if (std::holds_alternative<NodeStatementExit>(statement.expr)) {
-                    const auto& exit_stmt = std::get<NodeStatementExit>(statement.expr);
-                    code += generate_exit(exit_stmt.exit);
-                } else if (std::holds_alternative<NodeStatementLet>(statement.expr)) {
-                    const auto& let_stmt = std::get<NodeStatementLet>(statement.expr);
-                    code += generate_let(let_stmt);
-                } else if (std::holds_alternative<NodeStatementIf>(statement.expr)) {
-                    const auto& if_stmt = std::get<NodeStatementIf>(statement.expr);
-                    code += generate_if(if_stmt);
-                } else if (std::holds_alternative<NodeScope>(statement.expr)) {
-                    const auto& nested_scope = std::get<NodeScope>(statement.expr);
-                    code += generate_scope(nested_scope);
-                } else if (std::holds_alternative<NodeStatementAssign>(statement.expr)) {
-                    const auto& assign_stmt = std::get<NodeStatementAssign>(statement.expr);
-                    code += generate_assignment(assign_stmt);
-                }
-            }
-            
-            // Pop scope
-            m_scope_stack.pop_back();
-            return code;
+        bool is_constant(ValueId value, uint32_t constant) const {
+            const IrInst& inst = m_program.values[value];
+            return inst.op == IrOp::constant && inst.imm == constant;
         }
 
-        std::string generate_assignment(const NodeStatementAssign& assign_stmt) {
-            std::string code;
-            const std::string& ident = assign_stmt.ident.value;
-            code += "\t# Assign " + ident + "\n";
-            
-            auto var_opt = find_in_any_scope(ident);
-            if (!var_opt) {
-                std::cerr << "Error: Undeclared variable '" << ident << "' in assignment.\n";
-                return code;
-            }
-
-            size_t old_stack_size = m_stack_size;
-            code += generate_expr(assign_stmt.value);
-            
-            code += "\tldr\tw0, [sp], #16\n";
-            m_stack_size = old_stack_size;
-            
-            size_t var_stack_pos = var_opt->stack_offset;
-            size_t offset_from_current_sp = m_stack_size - var_stack_pos - 16;
-            code += "\tstr\tw0, [sp, #" + std::to_string(offset_from_current_sp) + "]\n";
-            
-            return code;
+        // Where a value is, for moving it into a phi
+        struct Location {
+            enum class Kind : uint8_t {
+                none,       // undef: nothing to move
+                reg,
+                cell,
+                constant,
+            };
+            Kind kind;
+            uint32_t n;     // register, cell or constant
+
+            bool operator==(const Location&) const = default;
+        };
+
+        Location location(ValueId value) const {
+            if (m_registers.in_register(value)) {
+                return Location{Location::Kind::reg, m_registers.registers[value]};
+            }
+            const IrInst& inst = m_program.values[value];
+            if (inst.op == IrOp::constant) {
+                return Location{Location::Kind::constant, inst.imm};
+            }
+            if (m_registers.in_cell(value)) {
+                return Location{Location::Kind::cell, m_registers.cells[value]};
+            }
+            return Location{Location::Kind::none, 0};
         }
 
-        std::string generate_program() {
-            std::string code;
-            code += ".globl\t_main\n.p2align 2\n_main:\n";
-
-            for (const auto& statement : m_program.statements) {
-                if (std::holds_alternative<NodeStatementExit>(statement.expr)) {
-                    const auto& exit_stmt = std::get<NodeStatementExit>(statement.expr);
-                    code += generate_exit(exit_stmt.exit);
-                } else if (std::holds_alternative<NodeStatementLet>(statement.expr)) {
-                    const auto& let_stmt = std::get<NodeStatementLet>(statement.expr);
-                    code += generate_let(let_stmt);
-                } else if (std::holds_alternative<NodeStatementIf>(statement.expr)) {
-                    const auto& if_stmt = std::get<NodeStatementIf>(statement.expr);
-                    code += generate_if(if_stmt);
-                } else if (std::holds_alternative<NodeScope>(statement.expr)) {
-                    const auto& scope = std::get<NodeScope>(statement.expr);
-                    code += generate_scope(scope);
-                } else if (std::holds_alternative<NodeStatementAssign>(statement.expr)) {
-                    const auto& assign_stmt = std::get<NodeStatementAssign>(statement.expr);
-                    code += generate_assignment(assign_stmt);
-                }
-            }
-
-            code += "\t# Default exit\n";
-            code += "\tmov\tw0, #0\n";
-            code += "\tmov\tx16, #1\n"; // syscall for exit
-            code += "\tsvc\t#0x80\n";   // make the syscall
-            return code;
+        // A register or cell, as an index into m_readers
+        size_t location_key(const Location& location) const {
+            return location.kind == Location::Kind::reg ? location.n : 32 + location.n;
         }
 
-        std::string generate_statement() {
-            std::string code;
-            code += generate_program();
-            return code;
+        bool is_storage(const Location& location) const {
+            return location.kind == Location::Kind::reg || location.kind == Location::Kind::cell;
         }
 
-    private:
+        struct Move {
+            Location dst;
+            Location src;
+        };
+        std::vector<Move> m_moves;
+        std::vector<uint32_t> m_readers;    // pending moves reading each location
+        std::vector<uint32_t> m_writer;     // the pending move writing each location
+
+        // Copy the arguments `from` passes into the phis of `to`, all at
+        // once: a move runs once no other pending move still reads its
+        // destination, and when every pending move is waiting on another
+        // (a cycle, like two variables swapping), one destination is saved
+        // in a scratch register and read from there.
+        void generate_phi_moves(BlockId from, BlockId to) {
+            const IrBlock& target = m_program.blocks[to];
+            const size_t pred = static_cast<size_t>(
+                std::find(target.preds.begin(), target.preds.end(), from) - target.preds.begin());
+            m_moves.clear();
+            for (ValueId id : target.insts) {
+                const IrInst& phi = m_program.values[id];
+                if (phi.op != IrOp::phi) {
+                    break;
+                }
+                const Location src = location(m_program.args(phi)[pred]);
+                const Location dst = location(id);
+                if (src.kind != Location::Kind::none && src != dst) {
+                    m_moves.push_back(Move{dst, src});
+                }
+            }
+            if (m_moves.empty()) {
+                return;
+            }
+
+            const size_t keys = 32 + m_registers.cell_count;
+            m_readers.assign(keys, 0);
+            m_writer.assign(keys, no_value);
+            for (uint32_t i = 0; i < m_moves.size(); i++) {
+                if (is_storage(m_moves[i].src)) {
+                    m_readers[location_key(m_moves[i].src)]++;
+                }
+                m_writer[location_key(m_moves[i].dst)] = i;
+            }
+            std::vector<uint32_t> ready;
+            for (uint32_t i = 0; i < m_moves.size(); i++) {
+                if (m_readers[location_key(m_moves[i].dst)] == 0) {
+                    ready.push_back(i);
+                }
+            }
+
+            size_t remaining = m_moves.size();
+            std::vector<bool> done(m_moves.size(), false);
+            size_t cursor = 0;
+            while (remaining != 0) {
+                while (!ready.empty()) {
+                    const uint32_t i = ready.back();
+                    ready.pop_back();
+                    const Move move = m_moves[i];
+                    generate_move(move.dst, move.src);
+                    done[i] = true;
+                    remaining--;
+                    if (is_storage(move.src) && --m_readers[location_key(move.src)] == 0) {
+                        const uint32_t writer = m_writer[location_key(move.src)];
+                        if (writer != no_value && !done[writer]) {
+                            ready.push_back(writer);
+                        }
+                    }
+                }
+                if (remaining == 0) {
+                    break;
+                }
+                while (done[cursor]) {
+                    cursor++;
+                }
+                // Only cycles are left: free the destination of one move
+                const Location saved = m_moves[cursor].dst;
+                const Location temp{Location::Kind::reg, scratch2};
+                generate_move(temp, saved);
+                for (uint32_t i = 0; i < m_moves.size(); i++) {
+                    if (!done[i] && m_moves[i].src == saved) {
+                        m_moves[i].src = temp;
+                    }
+                }
+                m_readers[location_key(saved)] = 0;
+                ready.push_back(cursor);
+            }
+        }
 
-        struct Var {
-            size_t stack_offset; // Offset from current stack pointer
+        void generate_move(const Location& dst, const Location& src) {
+            uint8_t reg = dst.kind == Location::Kind::reg ? static_cast<uint8_t>(dst.n) : scratch;
+            switch (src.kind) {
+                case Location::Kind::reg:
+                    if (dst.kind == Location::Kind::reg) {
+                        m_code.push_back(Instr::mov(reg, static_cast<uint8_t>(src.n)));
+                    } else {
+                        reg = static_cast<uint8_t>(src.n);
+                    }
+                    break;
+                case Location::Kind::cell:
+                    m_code.push_back(Instr::memory(Opcode::ldr, reg, (m_slot_cells + src.n) * slot_size));
+                    break;
+                case Location::Kind::constant:
+                    load_constant(reg, src.n);
+                    break;
+                case Location::Kind::none:
+                    break;
+            }
+            if (dst.kind == Location::Kind::cell) {
+                m_code.push_back(Instr::memory(Opcode::str, reg, (m_slot_cells + dst.n) * slot_size));
+            }
+        }
+
+        // An add, sub or comparison with a constant operand the instruction
+        // can encode: only `operand` goes in a register, and the constant
+        // becomes the instruction's immediate
+        struct ImmediateForm {
+            Opcode op = Opcode::nop;    // add, sub or cmp
+            uint32_t imm = 0;
+            ValueId operand = no_value;
+            Cond cond = Cond::eq;       // cmp: the condition, operands swapped if need be
         };
 
-        NodeProgram m_program;
-        size_t m_stack_size = 0; // Track total stack space used
-        std::vector<std::map<std::string, Var>> m_scope_stack; // Stack of variable maps
-        size_t m_label_counter = 0;
+        // x + c and x - c use add or sub #c, or the other one with #-c when
+        // that encodes instead, and comparisons with a constant use cmp #c
+        ImmediateForm plan_immediate(const IrInst& inst) const {
+            const IrInst& lhs = m_program.values[inst.a];
+            const IrInst& rhs = m_program.values[inst.b];
+            const bool lhs_const = lhs.op == IrOp::constant;
+            const bool rhs_const = rhs.op == IrOp::constant;
+
+            if (inst.op == IrOp::add || inst.op == IrOp::sub) {
+                if (!rhs_const && !(inst.op == IrOp::add && lhs_const)) {
+                    return ImmediateForm{};
+                }
+                const uint32_t value = rhs_const ? rhs.imm : lhs.imm;
+                const ValueId operand = rhs_const ? inst.a : inst.b;
+                const Opcode op = inst.op == IrOp::add ? Opcode::add : Opcode::sub;
+                const Opcode inverse = op == Opcode::add ? Opcode::sub : Opcode::add;
+                if (arith_immediate(value)) {
+                    return ImmediateForm{op, value, operand};
+                }
+                if (arith_immediate(0u - value)) {
+                    return ImmediateForm{inverse, 0u - value, operand};
+                }
+            } else if (is_comparison(inst.op)) {
+                if (rhs_const && arith_immediate(rhs.imm)) {
+                    return ImmediateForm{Opcode::cmp, rhs.imm, inst.a, condition_code(inst.op)};
+                }
+                if (lhs_const && arith_immediate(lhs.imm)) {
+                    return ImmediateForm{Opcode::cmp, lhs.imm, inst.b, swap_operands(condition_code(inst.op))};
+                }
+            }
+            return ImmediateForm{};
+        }
+
+        Reduction plan_reduction(const IrInst& inst) const {
+            const IrInst& lhs = m_program.values[inst.a];
+            const IrInst& rhs = m_program.values[inst.b];
+            if (inst.op == IrOp::mul) {
+                if (rhs.op == IrOp::constant) {
+                    return plan_multiply(rhs.imm, m_costs);
+                }
+                if (lhs.op == IrOp::constant) {
+                    return plan_multiply(lhs.imm, m_costs);
+                }
+            } else if (inst.op == IrOp::div && rhs.op == IrOp::constant) {
+                return plan_divide(rhs.imm, m_costs);
+            }
+            return Reduction{};
+        }
 
-        // Helper function to find variable in current scope
-        bool find_in_current_scope(const std::string& ident) {
-            return m_scope_stack.back().find(ident) != m_scope_stack.back().end();
+        // The operand of a strength reduced instruction that is not the constant
+        ValueId reduced_operand(const IrInst& inst) const {
+            return m_program.values[inst.b].op == IrOp::constant ? inst.a : inst.b;
         }
 
-        // Helper function to find variable in any scope
-        std::optional<Var> find_in_any_scope(const std::string& ident) {
-            for (auto it = m_scope_stack.rbegin(); it != m_scope_stack.rend(); ++it) {
-                if (it->find(ident) != it->end()) {
-                    return it->at(ident);
+        // Multiply or divide `source` by a constant into `out` as `reduction`
+        // says; out may be source
+        void generate_reduction(const Reduction& reduction, uint8_t source, uint8_t out) {
+            if (reduction.kind == Reduction::Kind::steps) {
+                for (uint8_t i = 0; i < reduction.count; i++) {
+                    const uint8_t amount = reduction.shifts[i];
+                    switch (reduction.steps[i]) {
+                        case Reduction::Step::lsl:
+                            m_code.push_back(Instr::shift(Opcode::lsl, out, source, amount));
+                            break;
+                        case Reduction::Step::lsr:
+                            m_code.push_back(Instr::shift(Opcode::lsr, out, source, amount));
+                            break;
+                        case Reduction::Step::add_lsl:
+                            m_code.push_back(Instr::shifted(Opcode::add, out, source, source, Shift::lsl, amount));
+                            break;
+                        case Reduction::Step::sub_lsl:
+                            m_code.push_back(Instr::shifted(Opcode::sub, out, source, source, Shift::lsl, amount));
+                            break;
+                        case Reduction::Step::neg:
+                            m_code.push_back(Instr::neg(out, source));
+                            break;
+                    }
+                    source = out;
                 }
+                return;
+            }
+            const uint8_t magic = scratch2;
+            load_constant(magic, reduction.magic);
+            if (reduction.kind == Reduction::Kind::magic) {
+                m_code.push_back(Instr::binary(Opcode::umull, out, source, magic));
+                m_code.push_back(Instr::shift(Opcode::lsr_x, out, out, 32u + reduction.shift));
+            } else {
+                // t = high half of n * m, kept in the magic register
+                m_code.push_back(Instr::binary(Opcode::umull, magic, source, magic));
+                m_code.push_back(Instr::shift(Opcode::lsr_x, magic, magic, 32));
+                m_code.push_back(Instr::binary(Opcode::sub, out, source, magic));
+                m_code.push_back(Instr::shifted(Opcode::add, out, magic, out, Shift::lsr, 1));
+                m_code.push_back(Instr::shift(Opcode::lsr, out, out, reduction.shift));
+            }
+        }
+
+        // Any 32-bit constant: one mov (movz or movn) where that reaches it,
+        // otherwise a mov of the low half and a movk of the high half
+        void load_constant(uint8_t dst, uint32_t value) {
+            if (single_move(value)) {
+                m_code.push_back(Instr::mov_imm(dst, value));
+                return;
+            }
+            m_code.push_back(Instr::mov_imm(dst, value & 0xffff));
+            m_code.push_back(Instr::movk(dst, value >> 16));
+        }
+
+        // Comparisons are unsigned
+        static Cond condition_code(IrOp op) {
+            switch (op) {
+                case IrOp::ne:
+                    return Cond::ne;
+                case IrOp::lt:
+                    return Cond::lo;
+                case IrOp::le:
+                    return Cond::ls;
+                case IrOp::gt:
+                    return Cond::hi;
+                case IrOp::ge:
+                    return Cond::hs;
+                default:
+                    return Cond::eq;
+            }
+        }
+
+        static Opcode machine_op(IrOp op) {
+            switch (op) {
+                case IrOp::add:
+                    return Opcode::add;
+                case IrOp::sub:
+                    return Opcode::sub;     // left - right
+                case IrOp::mul:
+                    return Opcode::mul;
+                case IrOp::div:
+                    return Opcode::udiv;
+                default:
+                    return Opcode::nop;
             }
-            return std::nullopt;
         }
-};
\ No newline at end of file
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "dominators.hpp"
+#include "ir.hpp"
+
+// Value numbering over the dominator tree (Briggs, Cooper & Simpson,
+// "Value Numbering", the dominator-based variant).
+//
+// In SSA form an assignment makes a new value instead of changing the old
+// one, so two instructions with the same operator and the same operand
+// values compute the same thing, and the first can stand in for the second
+// anywhere it dominates it. A walk down the dominator tree keeps a table
+// from (operator, operands) to the first instruction computing it, with the
+// same kind of undo log as Mem2Reg so that leaving a block's subtree forgets
+// what the subtree added. An instruction found in the table is deleted and
+// its uses read the earlier one instead. Operands are rewritten before an
+// instruction is looked up, so (a + b) * c matches all the way up once
+// a + b has.
+//
+// Commutative operators are keyed with their operands in id order, and
+// x > y as y < x (likewise >=), so that operand order hides no match. Each
+// constant becomes one value. A phi whose arguments are all one value is
+// that value, and so is a second phi in the same block with the same
+// arguments as the first.
+class ValueNumbering {
+    public:
+        inline ValueNumbering(IrProgram& program, const DominatorTree& tree)
+            : m_program(program), m_tree(tree) {}
+
+        // Returns the number of instructions replaced, constants included
+        size_t run() {
+            const DominatorTree& tree = m_tree;
+            m_replacement.assign(m_program.values.size(), no_value);
+
+            // Block, undo log mark, next child, as in Mem2Reg::rename
+            struct Frame {
+                BlockId block;
+                size_t mark;
+                size_t next;
+            };
+            std::vector<Frame> stack;
+            stack.push_back(Frame{m_program.entry, 0, 0});
+            enter(m_program.entry);
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                const std::vector<BlockId>& children = tree.children(frame.block);
+                if (frame.next == children.size()) {
+                    while (m_undo.size() > frame.mark) {
+                        m_table.erase(m_undo.back());
+                        m_undo.pop_back();
+                    }
+                    stack.pop_back();
+                    continue;
+                }
+                const BlockId child = children[frame.next++];
+                stack.push_back(Frame{child, m_undo.size(), 0});
+                enter(child);
+            }
+            return m_local + m_global + m_phis + m_constants;
+        }
+
+        void report(std::ostream& out) const {
+            out << "gvn: " << m_local + m_global + m_phis << " expressions eliminated\n";
+            const std::pair<std::string_view, size_t> counts[] = {
+                {"same block", m_local},
+                {"dominating block", m_global},
+                {"phis", m_phis},
+                {"constants", m_constants},
+            };
+            for (const auto& [name, count] : counts) {
+                out << "  " << std::left << std::setw(24) << name << count << "\n";
+            }
+        }
+
+    private:
+        struct Key {
+            IrOp op;
+            uint32_t a;     // operands, or the constant
+            uint32_t b;
+
+            bool operator==(const Key&) const = default;
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                uint64_t h = (static_cast<uint64_t>(key.a) << 32 | key.b) * 0x9e3779b97f4a7c15ull;
+                return static_cast<size_t>(h ^ (h >> 29) ^ static_cast<uint64_t>(key.op));
+            }
+        };
+
+        IrProgram& m_program;
+        const DominatorTree& m_tree;
+        std::unordered_map<Key, ValueId, KeyHash> m_table;
+        std::vector<Key> m_undo;                // keys added, innermost block last
+        std::vector<ValueId> m_replacement;     // by value: the value standing in for it
+        size_t m_local = 0;
+        size_t m_global = 0;
+        size_t m_phis = 0;
+        size_t m_constants = 0;
+
+        ValueId resolve(ValueId id) const {
+            return id != no_value && m_replacement[id] != no_value ? m_replacement[id] : id;
+        }
+
+        void replace(ValueId id, ValueId with) {
+            m_replacement[id] = with;
+            m_program.values[id].op = IrOp::nop;
+        }
+
+        static Key key_of(const IrInst& inst) {
+            switch (inst.op) {
+                case IrOp::constant:
+                    return Key{inst.op, inst.imm, 0};
+                case IrOp::add:
+                case IrOp::mul:
+                case IrOp::eq:
+                case IrOp::ne:
+                    return Key{inst.op, std::min(inst.a, inst.b), std::max(inst.a, inst.b)};
+                case IrOp::gt:
+                    return Key{IrOp::lt, inst.b, inst.a};
+                case IrOp::ge:
+                    return Key{IrOp::le, inst.b, inst.a};
+                default:
+                    return Key{inst.op, inst.a, inst.b};
+            }
+        }
+
+        void enter(BlockId block_id) {
+            IrBlock& block = m_program.blocks[block_id];
+            size_t kept = 0;
+            for (size_t i = 0; i < block.insts.size(); i++) {
+                const ValueId id = block.insts[i];
+                IrInst& inst = m_program.values[id];
+                if (inst.op == IrOp::phi) {
+                    if (const ValueId same = redundant_phi(block, kept, inst); same != no_value) {
+                        replace(id, same);
+                        m_phis++;
+                        continue;
+                    }
+                } else if (is_binary(inst.op) || inst.op == IrOp::constant) {
+                    inst.a = resolve(inst.a);
+                    inst.b = resolve(inst.b);
+                    const Key key = key_of(inst);
+                    if (auto found = m_table.find(key); found != m_table.end()) {
+                        if (inst.op == IrOp::constant) {
+                            m_constants++;
+                        } else if (m_program.values[found->second].block == block_id) {
+                            m_local++;
+                        } else {
+                            m_global++;
+                        }
+                        replace(id, found->second);
+                        continue;
+                    }
+                    m_table.emplace(key, id);
+                    m_undo.push_back(key);
+                } else if (inst.op == IrOp::store) {
+                    inst.a = resolve(inst.a);
+                }
+                block.insts[kept++] = id;
+            }
+            block.insts.resize(kept);
+            if (block.value != no_value) {
+                block.value = resolve(block.value);
+            }
+        }
+
+        // What `phi` can be replaced by, after rewriting its arguments: the
+        // one value all of them are, or an earlier phi among the first
+        // `kept` instructions of `block` with the same arguments
+        ValueId redundant_phi(const IrBlock& block, size_t kept, const IrInst& phi) {
+            std::span<ValueId> args = m_program.args(phi);
+            bool same = true;
+            for (ValueId& arg : args) {
+                arg = resolve(arg);
+                same = same && arg == args[0];
+            }
+            if (same && !args.empty()) {
+                return args[0];
+            }
+            for (size_t i = 0; i < kept; i++) {
+                const ValueId other = block.insts[i];
+                const std::span<const ValueId> other_args = std::as_const(m_program).args(m_program.values[other]);
+                if (std::equal(args.begin(), args.end(), other_args.begin(), other_args.end())) {
+                    return other;
+                }
+            }
+            return no_value;
+        }
+};
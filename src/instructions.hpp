@@ -0,0 +1,360 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "emitter.hpp"
+
+// Register numbers are w<n>; no_register marks an absent operand
+inline constexpr uint8_t no_register = 0xff;
+
+enum class Opcode : uint8_t {
+    nop,        // deleted instruction, prints nothing
+    label,      // .L<imm>: the start of block imm
+    mov,        // rd = rm, or rd = #imm without rm (see single_move)
+    movk,       // rd[31:16] = #imm
+    add,        // rd = rn op rm, or rd = rn op #imm without rm (add/sub,
+    sub,        // see arith_immediate); with rm, shift rm by a non-zero imm
+    mul,
+    udiv,
+    lsl,        // rd = rn shifted by #imm
+    lsr,
+    neg,        // rd = -rm
+    umull,      // xd = wn * wm, the full 64-bit product
+    lsr_x,      // xd = xn >> #imm
+    cmp,        // flags from rn - rm, or rn - #imm without rm
+    cset,       // rd = cond ? 1 : 0
+    b,          // branch to label imm
+    b_cond,     // branch to label imm if cond
+    cbz,        // branch to label imm if rn is zero
+    cbnz,
+    ldr,        // rd = [sp, #imm]
+    str,        // [sp, #imm] = rd
+    frame,      // sub sp, sp, #imm: reserve the stack frame
+    exit,       // exit syscall with status w0: mov x16, #1; svc #0x80
+};
+
+// An add/sub/cmp immediate: 12 bits, optionally shifted left by 12
+inline bool arith_immediate(uint32_t value) {
+    return value <= 0xfff || ((value & 0xfff) == 0 && value <= 0xfff000);
+}
+
+// A constant one mov can load: movz of either half, or movn of the low half
+inline bool single_move(uint32_t value) {
+    return value <= 0xffff || (value & 0xffff) == 0 || ~value <= 0xffff;
+}
+
+// Condition codes, for the unsigned comparisons the language has
+enum class Cond : uint8_t {
+    eq,
+    ne,
+    lo,
+    ls,
+    hi,
+    hs,
+};
+
+inline Cond invert(Cond cond) {
+    switch (cond) {
+        case Cond::eq:
+            return Cond::ne;
+        case Cond::ne:
+            return Cond::eq;
+        case Cond::lo:
+            return Cond::hs;
+        case Cond::ls:
+            return Cond::hi;
+        case Cond::hi:
+            return Cond::ls;
+        case Cond::hs:
+            return Cond::lo;
+    }
+    return cond;
+}
+
+// The condition that holds for b op a when `cond` holds for a op b
+inline Cond swap_operands(Cond cond) {
+    switch (cond) {
+        case Cond::lo:
+            return Cond::hi;
+        case Cond::ls:
+            return Cond::hs;
+        case Cond::hi:
+            return Cond::lo;
+        case Cond::hs:
+            return Cond::ls;
+        default:
+            return cond;
+    }
+}
+
+// How add/sub shift their register operand
+enum class Shift : uint8_t {
+    lsl,
+    lsr,
+};
+
+// One AArch64 instruction (or label) as the generator produced
+// it. Later passes rewrite the list in place of pattern matching on text.
+struct Instr {
+    Opcode op = Opcode::nop;
+    uint8_t rd = no_register;
+    uint8_t rn = no_register;
+    uint8_t rm = no_register;
+    uint8_t kind = 0;           // Shift
+    Cond cond = Cond::eq;       // cset, b_cond
+    uint32_t imm = 0;           // immediate, shift, stack offset or label number
+
+    static Instr label(uint32_t number) {
+        return Instr{Opcode::label, no_register, no_register, no_register, 0, Cond::eq, number};
+    }
+
+    static Instr branch(uint32_t number) {
+        return Instr{Opcode::b, no_register, no_register, no_register, 0, Cond::eq, number};
+    }
+
+    static Instr branch_if(Cond cond, uint32_t number) {
+        return Instr{Opcode::b_cond, no_register, no_register, no_register, 0, cond, number};
+    }
+
+    // cbz or cbnz on rn
+    static Instr branch_zero(Opcode op, uint8_t rn, uint32_t number) {
+        return Instr{op, no_register, rn, no_register, 0, Cond::eq, number};
+    }
+
+    static Instr cset(uint8_t rd, Cond cond) {
+        return Instr{Opcode::cset, rd, no_register, no_register, 0, cond, 0};
+    }
+
+    static Instr mov(uint8_t rd, uint8_t rm) {
+        return Instr{Opcode::mov, rd, no_register, rm, 0, Cond::eq, 0};
+    }
+
+    static Instr mov_imm(uint8_t rd, uint32_t imm) {
+        return Instr{Opcode::mov, rd, no_register, no_register, 0, Cond::eq, imm};
+    }
+
+    static Instr movk(uint8_t rd, uint32_t imm) {
+        return Instr{Opcode::movk, rd, no_register, no_register, 0, Cond::eq, imm};
+    }
+
+    static Instr binary(Opcode op, uint8_t rd, uint8_t rn, uint8_t rm) {
+        return Instr{op, rd, rn, rm, 0, Cond::eq, 0};
+    }
+
+    // rd = rn op #imm, for add and sub
+    static Instr binary_imm(Opcode op, uint8_t rd, uint8_t rn, uint32_t imm) {
+        return Instr{op, rd, rn, no_register, 0, Cond::eq, imm};
+    }
+
+    // rd = rn op (rm shifted by amount), for add and sub
+    static Instr shifted(Opcode op, uint8_t rd, uint8_t rn, uint8_t rm, Shift shift, uint32_t amount) {
+        return Instr{op, rd, rn, rm, static_cast<uint8_t>(shift), Cond::eq, amount};
+    }
+
+    // lsl, lsr and lsr_x by an immediate
+    static Instr shift(Opcode op, uint8_t rd, uint8_t rn, uint32_t amount) {
+        return Instr{op, rd, rn, no_register, 0, Cond::eq, amount};
+    }
+
+    static Instr neg(uint8_t rd, uint8_t rm) {
+        return Instr{Opcode::neg, rd, no_register, rm, 0, Cond::eq, 0};
+    }
+
+    static Instr cmp_imm(uint8_t rn, uint32_t imm) {
+        return Instr{Opcode::cmp, no_register, rn, no_register, 0, Cond::eq, imm};
+    }
+
+    // Memory at a fixed offset from sp
+    static Instr memory(Opcode op, uint8_t rd, uint32_t offset) {
+        return Instr{op, rd, no_register, no_register, 0, Cond::eq, offset};
+    }
+
+    static Instr frame(uint32_t size) {
+        return Instr{Opcode::frame, no_register, no_register, no_register, 0, Cond::eq, size};
+    }
+
+    static Instr exit() {
+        return Instr{Opcode::exit, no_register, no_register, no_register, 0, Cond::eq, 0};
+    }
+
+    bool has_immediate() const {
+        return rm == no_register;
+    }
+
+    bool is_branch() const {
+        return op == Opcode::b || op == Opcode::b_cond || op == Opcode::cbz || op == Opcode::cbnz;
+    }
+
+    bool reads(uint8_t reg) const {
+        switch (op) {
+            case Opcode::mov:
+            case Opcode::neg:
+                return rm == reg;
+            case Opcode::lsl:
+            case Opcode::lsr:
+            case Opcode::lsr_x:
+            case Opcode::cbz:
+            case Opcode::cbnz:
+                return rn == reg;
+            case Opcode::movk:
+                return rd == reg;
+            case Opcode::add:
+            case Opcode::sub:
+            case Opcode::mul:
+            case Opcode::udiv:
+            case Opcode::umull:
+            case Opcode::cmp:
+                return rn == reg || rm == reg;
+            case Opcode::str:
+                return rd == reg;
+            case Opcode::exit:
+                return reg == 0;
+            default:
+                return false;
+        }
+    }
+
+    bool writes(uint8_t reg) const {
+        switch (op) {
+            case Opcode::mov:
+            case Opcode::movk:
+            case Opcode::add:
+            case Opcode::sub:
+            case Opcode::mul:
+            case Opcode::udiv:
+            case Opcode::lsl:
+            case Opcode::lsr:
+            case Opcode::neg:
+            case Opcode::umull:
+            case Opcode::lsr_x:
+            case Opcode::cset:
+            case Opcode::ldr:
+                return rd == reg;
+            default:
+                return false;
+        }
+    }
+};
+
+// "#imm" or "#imm >> 12, lsl #12", for a value arith_immediate accepts
+inline void emit_arith_immediate(Emitter& out, uint32_t value) {
+    if (value <= 0xfff) {
+        out.emit("#", value, "\n");
+    } else {
+        out.emit("#", value >> 12, ", lsl #12\n");
+    }
+}
+
+// Render the instruction list as the assembly file for `_main`
+inline void write_program(Emitter& out, const std::vector<Instr>& code) {
+    static constexpr std::string_view cond_names[] = {"eq", "ne", "lo", "ls", "hi", "hs"};
+    using Reg = Emitter::Reg;
+    // ldr/str wN, [sp, #imm] encode imm / 4 in 12 bits
+    static constexpr uint32_t max_scaled_offset = 4095 * 4;
+
+    out.emit(".globl\t_main\n.p2align 2\n_main:\n");
+    for (const Instr& instr : code) {
+        switch (instr.op) {
+            case Opcode::nop:
+                break;
+            case Opcode::label:
+                out.emit(Emitter::Label{instr.imm}, ":\n");
+                break;
+            case Opcode::mov:
+                if (!instr.has_immediate()) {
+                    out.emit("\tmov\t", Reg{instr.rd}, ", ", Reg{instr.rm}, "\n");
+                } else if (instr.imm <= 0xffff) {
+                    out.emit("\tmov\t", Reg{instr.rd}, ", #", instr.imm, "\n");
+                } else if ((instr.imm & 0xffff) == 0) {
+                    out.emit("\tmovz\t", Reg{instr.rd}, ", #", instr.imm >> 16, ", lsl #16\n");
+                } else {
+                    out.emit("\tmovn\t", Reg{instr.rd}, ", #", ~instr.imm & 0xffff, "\n");
+                }
+                break;
+            case Opcode::movk:
+                out.emit("\tmovk\t", Reg{instr.rd}, ", #", instr.imm, ", lsl #16\n");
+                break;
+            case Opcode::add:
+            case Opcode::sub:
+            case Opcode::mul:
+            case Opcode::udiv: {
+                static constexpr std::string_view names[] = {"add", "sub", "mul", "udiv"};
+                out.emit("\t", names[static_cast<int>(instr.op) - static_cast<int>(Opcode::add)], "\t",
+                         Reg{instr.rd}, ", ", Reg{instr.rn}, ", ");
+                if (instr.has_immediate()) {
+                    emit_arith_immediate(out, instr.imm);
+                } else if (instr.imm != 0) {
+                    out.emit(Reg{instr.rm}, static_cast<Shift>(instr.kind) == Shift::lsl ? ", lsl #" : ", lsr #",
+                             instr.imm, "\n");
+                } else {
+                    out.emit(Reg{instr.rm}, "\n");
+                }
+                break;
+            }
+            case Opcode::lsl:
+                out.emit("\tlsl\t", Reg{instr.rd}, ", ", Reg{instr.rn}, ", #", instr.imm, "\n");
+                break;
+            case Opcode::lsr:
+                out.emit("\tlsr\t", Reg{instr.rd}, ", ", Reg{instr.rn}, ", #", instr.imm, "\n");
+                break;
+            case Opcode::neg:
+                out.emit("\tneg\t", Reg{instr.rd}, ", ", Reg{instr.rm}, "\n");
+                break;
+            case Opcode::umull:
+                out.emit("\tumull\tx", static_cast<unsigned>(instr.rd), ", ", Reg{instr.rn}, ", ", Reg{instr.rm}, "\n");
+                break;
+            case Opcode::lsr_x:
+                out.emit("\tlsr\tx", static_cast<unsigned>(instr.rd), ", x", static_cast<unsigned>(instr.rn), ", #", instr.imm, "\n");
+                break;
+            case Opcode::cmp:
+                if (instr.has_immediate()) {
+                    out.emit("\tcmp\t", Reg{instr.rn}, ", ");
+                    emit_arith_immediate(out, instr.imm);
+                } else {
+                    out.emit("\tcmp\t", Reg{instr.rn}, ", ", Reg{instr.rm}, "\n");
+                }
+                break;
+            case Opcode::b:
+                out.emit("\tb\t", Emitter::Label{instr.imm}, "\n");
+                break;
+            case Opcode::b_cond:
+                out.emit("\tb.", cond_names[static_cast<int>(instr.cond)], "\t",
+                         Emitter::Label{instr.imm}, "\n");
+                break;
+            case Opcode::cbz:
+            case Opcode::cbnz:
+                out.emit(instr.op == Opcode::cbz ? "\tcbz\t" : "\tcbnz\t", Reg{instr.rn}, ", ",
+                         Emitter::Label{instr.imm}, "\n");
+                break;
+            case Opcode::cset:
+                out.emit("\tcset\t", Reg{instr.rd}, ", ", cond_names[static_cast<int>(instr.cond)], "\n");
+                break;
+            case Opcode::ldr:
+            case Opcode::str: {
+                const char* name = instr.op == Opcode::ldr ? "\tldr\t" : "\tstr\t";
+                if (instr.imm <= max_scaled_offset) {
+                    out.emit(name, Reg{instr.rd}, ", [sp, #", instr.imm, "]\n");
+                } else {
+                    // Past the reach of a scaled 12-bit offset: address the
+                    // slot through x17 (IP1, free for this)
+                    out.emit("\tadd\tx17, sp, #", instr.imm >> 12, ", lsl #12\n");
+                    out.emit(name, Reg{instr.rd}, ", [x17, #", instr.imm & 0xfff, "]\n");
+                }
+                break;
+            }
+            case Opcode::frame:
+                if (instr.imm >> 12) {
+                    out.emit("\tsub\tsp, sp, #", instr.imm >> 12, ", lsl #12\n");
+                }
+                if (instr.imm & 0xfff) {
+                    out.emit("\tsub\tsp, sp, #", instr.imm & 0xfff, "\n");
+                }
+                break;
+            case Opcode::exit:
+                out.emit("\tmov\tx16, #1\n");   // syscall for exit
+                out.emit("\tsvc\t#0x80\n");     // make the syscall
+                break;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Identifiers are interned once, when they are lexed, and every later phase
+// works with the resulting SymbolId: equal names get equal IDs, so comparing
+// or hashing a name is an integer operation. IDs are dense, starting at 0.
+using SymbolId = uint32_t;
+inline constexpr SymbolId no_symbol = UINT32_MAX;
+
+// Process-wide identifier table, safe to share between threads compiling
+// different files. Each thread first checks a small direct-mapped cache of
+// names it has interned recently, which needs no locking; a miss looks the
+// name up under a shared lock, and only the first occurrence of a name takes
+// the lock exclusively. Names are copied into the interner, so IDs and the
+// text they map to stay valid after the source buffer they were lexed from
+// is gone.
+class Interner {
+    public:
+        static Interner& global() {
+            static Interner instance;
+            return instance;
+        }
+
+        SymbolId intern(std::string_view name) {
+            static thread_local std::array<CacheEntry, cache_size> cache{};
+            CacheEntry& cached = cache[std::hash<std::string_view>{}(name) % cache_size];
+            if (cached.name == name && cached.id != no_symbol) {
+                return cached.id;
+            }
+            const auto [stored, id] = lookup_or_insert(name);
+            cached = CacheEntry{stored, id};
+            return id;
+        }
+
+        std::string_view text(SymbolId id) const {
+            std::shared_lock lock(m_mutex);
+            return m_names[id];
+        }
+
+        size_t size() const {
+            std::shared_lock lock(m_mutex);
+            return m_names.size();
+        }
+
+    private:
+        static constexpr size_t cache_size = 256;
+
+        // `name` views the interner's own copy, which never changes once
+        // published, so a cache hit can compare against it without the lock
+        struct CacheEntry {
+            std::string_view name;
+            SymbolId id = no_symbol;
+        };
+
+        Interner() = default;
+
+        std::pair<std::string_view, SymbolId> lookup_or_insert(std::string_view name) {
+            {
+                std::shared_lock lock(m_mutex);
+                auto it = m_ids.find(name);
+                if (it != m_ids.end()) {
+                    return *it;
+                }
+            }
+            std::unique_lock lock(m_mutex);
+            // Another thread may have added it between the two locks
+            auto it = m_ids.find(name);
+            if (it != m_ids.end()) {
+                return *it;
+            }
+            const SymbolId id = static_cast<SymbolId>(m_names.size());
+            // deque::emplace_back never moves existing elements, so the
+            // views used as map keys stay valid
+            const std::string& stored = m_names.emplace_back(name);
+            m_ids.emplace(std::string_view(stored), id);
+            return {std::string_view(stored), id};
+        }
+
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<std::string_view, SymbolId> m_ids;
+        std::deque<std::string> m_names;
+};
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "parser.hpp"
+
+// SSA intermediate representation between the AST and code generation.
+//
+// A program is a single function: a table of basic blocks and a table of
+// instructions, both indexed by 32-bit id like the AST's tables. Every
+// instruction defines one virtual register, named by its index (v<n>), so a
+// value and the instruction computing it are the same thing. A block lists
+// its instructions in order, phis first, and ends in a terminator: a jump,
+// a two-way branch on a value being non-zero, or the exit syscall. The
+// language has no loops, so the control-flow graph is acyclic.
+//
+// IrBuilder gives every variable slot of the bound AST a home that load and
+// store read and write; Mem2Reg (mem2reg.hpp) then promotes the slots to SSA
+// values, with phis where control flow joins. Deleted instructions stay in
+// the table as nop, so ids never change.
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+inline constexpr ValueId no_value = UINT32_MAX;
+inline constexpr BlockId no_block = UINT32_MAX;
+
+enum class IrOp : uint8_t {
+    nop,        // deleted
+    undef,      // any value: a variable read that no store reaches
+    constant,   // imm
+    // a op b on unsigned 32-bit values: wrapping add/sub/mul, division as
+    // udiv does it (x / 0 is 0), comparisons giving 0 or 1. Same order as
+    // ExprKind.
+    add,
+    sub,
+    mul,
+    div,
+    eq,
+    ne,
+    lt,
+    le,
+    gt,
+    ge,
+    phi,        // one argument per predecessor of the block, in order
+    load,       // the value of variable slot imm
+    store,      // variable slot imm = a; defines no value
+};
+
+inline bool is_binary(IrOp op) {
+    return op >= IrOp::add && op <= IrOp::ge;
+}
+
+inline bool is_comparison(IrOp op) {
+    return op >= IrOp::eq && op <= IrOp::ge;
+}
+
+inline IrOp binary_op(ExprKind kind) {
+    return static_cast<IrOp>(static_cast<int>(kind) - static_cast<int>(ExprKind::add) + static_cast<int>(IrOp::add));
+}
+
+struct IrInst {
+    IrOp op = IrOp::nop;
+    BlockId block = no_block;
+    // Binary ops: the operands. store: a is the value stored. phi: the
+    // arguments are phi_args[a, a + b).
+    ValueId a = no_value;
+    ValueId b = no_value;
+    uint32_t imm = 0;           // constant: the value; load, store: the slot
+};
+
+enum class IrTerm : uint8_t {
+    none,       // still being built
+    jump,       // to succs[0]
+    branch,     // to succs[0] if value is non-zero, else to succs[1]
+    exit,       // exit syscall with status value
+};
+
+struct IrBlock {
+    std::vector<ValueId> insts;
+    std::vector<BlockId> preds;     // a phi's n-th argument comes from preds[n]
+    IrTerm term = IrTerm::none;
+    ValueId value = no_value;
+    std::array<BlockId, 2> succs{no_block, no_block};
+
+    size_t succ_count() const {
+        return term == IrTerm::jump ? 1 : term == IrTerm::branch ? 2 : 0;
+    }
+
+    std::span<const BlockId> successors() const {
+        return {succs.data(), succ_count()};
+    }
+};
+
+// Move-only, like NodeProgram
+struct IrProgram {
+    IrProgram() = default;
+    IrProgram(IrProgram&&) = default;
+    IrProgram& operator=(IrProgram&&) = default;
+    IrProgram(const IrProgram&) = delete;
+    IrProgram& operator=(const IrProgram&) = delete;
+
+    std::vector<IrInst> values;
+    std::vector<IrBlock> blocks;
+    std::vector<ValueId> phi_args;
+    uint32_t slot_count = 0;
+    BlockId entry = 0;
+
+    BlockId add_block() {
+        blocks.emplace_back();
+        return static_cast<BlockId>(blocks.size() - 1);
+    }
+
+    ValueId add_value(IrInst inst) {
+        values.push_back(inst);
+        return static_cast<ValueId>(values.size() - 1);
+    }
+
+    // Append an instruction to the end of `block`
+    ValueId append(BlockId block, IrInst inst) {
+        inst.block = block;
+        const ValueId id = add_value(inst);
+        blocks[block].insts.push_back(id);
+        return id;
+    }
+
+    std::span<ValueId> args(const IrInst& phi) {
+        return {phi_args.data() + phi.a, phi.b};
+    }
+
+    std::span<const ValueId> args(const IrInst& phi) const {
+        return {phi_args.data() + phi.a, phi.b};
+    }
+
+    // End `from` with `term`, recording it as a predecessor of the targets
+    void terminate(BlockId from, IrTerm term, ValueId value, BlockId then_block = no_block,
+                   BlockId else_block = no_block) {
+        IrBlock& block = blocks[from];
+        block.term = term;
+        block.value = value;
+        block.succs = {then_block, else_block};
+        for (BlockId succ : block.successors()) {
+            blocks[succ].preds.push_back(from);
+        }
+    }
+
+    // Blocks still in the program: deleted ones have no terminator
+    size_t block_count() const {
+        return static_cast<size_t>(std::count_if(blocks.begin(), blocks.end(), [](const IrBlock& block) {
+            return block.term != IrTerm::none;
+        }));
+    }
+
+    size_t instruction_count() const {
+        size_t count = 0;
+        for (const IrBlock& block : blocks) {
+            count += block.insts.size();
+        }
+        return count;
+    }
+
+    // Call f(operand) for each value `inst` reads, phi arguments included
+    template <typename F>
+    void for_each_operand(const IrInst& inst, F&& f) const {
+        if (is_binary(inst.op)) {
+            f(inst.a);
+            f(inst.b);
+        } else if (inst.op == IrOp::store) {
+            f(inst.a);
+        } else if (inst.op == IrOp::phi) {
+            for (ValueId arg : args(inst)) {
+                f(arg);
+            }
+        }
+    }
+};
+
+// One line per instruction and terminator, each block headed by its
+// label and predecessors:
+//
+//     .2:                         ; preds .0 .1
+//         v7 = phi [.0 v3] [.1 v5]
+//         v8 = add v7, v4
+//         branch v8, .3, .4
+inline void print_ir(std::ostream& out, const IrProgram& program) {
+    static constexpr std::string_view names[] = {
+        "nop", "undef", "constant", "add", "sub", "mul", "div",
+        "eq", "ne", "lt", "le", "gt", "ge", "phi", "load", "store",
+    };
+    for (BlockId id = 0; id < program.blocks.size(); id++) {
+        const IrBlock& block = program.blocks[id];
+        if (block.term == IrTerm::none) {
+            continue;
+        }
+        out << "." << id << ":";
+        if (!block.preds.empty()) {
+            out << "\t\t; preds";
+            for (BlockId pred : block.preds) {
+                out << " ." << pred;
+            }
+        }
+        out << "\n";
+        for (ValueId value : block.insts) {
+            const IrInst& inst = program.values[value];
+            const std::string_view name = names[static_cast<int>(inst.op)];
+            out << "    ";
+            switch (inst.op) {
+                case IrOp::store:
+                    out << "store $" << inst.imm << ", v" << inst.a;
+                    break;
+                case IrOp::load:
+                    out << "v" << value << " = load $" << inst.imm;
+                    break;
+                case IrOp::constant:
+                    out << "v" << value << " = constant " << inst.imm;
+                    break;
+                case IrOp::phi: {
+                    out << "v" << value << " = phi";
+                    const std::span<const ValueId> args = program.args(inst);
+                    for (size_t i = 0; i < args.size(); i++) {
+                        out << " [." << block.preds[i] << " v" << args[i] << "]";
+                    }
+                    break;
+                }
+                default:
+                    out << "v" << value << " = " << name;
+                    if (is_binary(inst.op)) {
+                        out << " v" << inst.a << ", v" << inst.b;
+                    }
+                    break;
+            }
+            out << "\n";
+        }
+        switch (block.term) {
+            case IrTerm::jump:
+                out << "    jump ." << block.succs[0] << "\n";
+                break;
+            case IrTerm::branch:
+                out << "    branch v" << block.value << ", ." << block.succs[0] << ", ." << block.succs[1] << "\n";
+                break;
+            case IrTerm::exit:
+                out << "    exit v" << block.value << "\n";
+                break;
+            case IrTerm::none:
+                break;
+        }
+    }
+}
+
+// Lowers the bound, folded AST to IR. Each expression becomes a run of
+// instructions in the current block, and each if/elif/else chain a diamond:
+// the condition's block branches to the arm and to the next test (or the
+// else arm, or the join), and every arm jumps to one join block. The rest
+// of a scope after an exit is never lowered, and whatever follows the scope
+// goes to a fresh block nothing branches to.
+//
+// Operands are emitted in Sethi-Ullman order, the needier one first, so
+// that the register allocator later sees as few values live at once as the
+// tree allows.
+class IrBuilder {
+    public:
+        inline explicit IrBuilder(const NodeProgram& program)
+            : m_program(program) {}
+
+        IrProgram build() {
+            m_ir.slot_count = static_cast<uint32_t>(m_program.variables.size());
+            m_ir.entry = m_ir.add_block();
+            m_current = m_ir.entry;
+            build_statements(m_program.root_scope());
+            // The default exit
+            const ValueId zero = m_ir.append(m_current, IrInst{IrOp::constant, no_block, no_value, no_value, 0});
+            m_ir.terminate(m_current, IrTerm::exit, zero);
+            return std::move(m_ir);
+        }
+
+    private:
+        const NodeProgram& m_program;
+        IrProgram m_ir;
+        BlockId m_current = no_block;
+
+        // Scratch for build_expr
+        std::vector<uint8_t> m_need;
+        struct Frame {
+            NodeId id;
+            uint8_t stage;      // operands built so far
+        };
+        std::vector<Frame> m_frames;
+        std::vector<ValueId> m_results;
+
+        void build_statements(const NodeScope& scope) {
+            for (NodeId id = scope.first; id < scope.first + scope.count; id++) {
+                const NodeStatement& statement = m_program.statements[id];
+                switch (statement.kind) {
+                    case StmtKind::exit:
+                        m_ir.terminate(m_current, IrTerm::exit, build_expr(statement.expr));
+                        m_current = m_ir.add_block();
+                        return;
+                    case StmtKind::let:
+                    case StmtKind::assign:
+                        m_ir.append(m_current, IrInst{IrOp::store, no_block, build_expr(statement.expr), no_value, statement.var});
+                        break;
+                    case StmtKind::if_:
+                        build_if(statement);
+                        break;
+                    case StmtKind::scope:
+                        build_statements(m_program.scopes[statement.scope]);
+                        break;
+                }
+            }
+        }
+
+        void build_if(const NodeStatement& if_stmt) {
+            // Blocks ending each arm, to jump to the join once it exists
+            std::vector<BlockId> arm_ends;
+            ExprRange condition = if_stmt.expr;
+            NodeId scope = if_stmt.scope;
+            NodeId next = if_stmt.predicate;
+            while (true) {
+                const ValueId value = build_expr(condition);
+                const BlockId arm = m_ir.add_block();
+                const BlockId rest = m_ir.add_block();
+                m_ir.terminate(m_current, IrTerm::branch, value, arm, rest);
+                m_current = arm;
+                build_statements(m_program.scopes[scope]);
+                arm_ends.push_back(m_current);
+                m_current = rest;
+
+                if (next == null_node) {
+                    break;      // no else: `rest` is the join
+                }
+                const NodeIfPredicate& predicate = m_program.predicates[next];
+                if (predicate.is_else()) {
+                    build_statements(m_program.scopes[predicate.scope]);
+                    arm_ends.push_back(m_current);
+                    m_current = m_ir.add_block();
+                    break;
+                }
+                condition = predicate.condition;
+                scope = predicate.scope;
+                next = predicate.next;
+            }
+            for (BlockId arm_end : arm_ends) {
+                m_ir.terminate(arm_end, IrTerm::jump, no_value, m_current);
+            }
+        }
+
+        // The expression's instructions go at the end of the current block;
+        // returns the value of its root. Trees can be tens of thousands of
+        // nodes deep, so the walk keeps its own stack.
+        ValueId build_expr(ExprRange expr) {
+            compute_need(expr);
+            m_frames.clear();
+            m_results.clear();
+            m_frames.push_back(Frame{expr.root(), 0});
+            while (!m_frames.empty()) {
+                Frame& frame = m_frames.back();
+                const NodeExpr& node = m_program.exprs[frame.id];
+                if (node.kind == ExprKind::int_lit) {
+                    m_results.push_back(m_ir.append(m_current, IrInst{IrOp::constant, no_block, no_value, no_value, node.value()}));
+                    m_frames.pop_back();
+                    continue;
+                }
+                if (node.kind == ExprKind::ident) {
+                    m_results.push_back(m_ir.append(m_current, IrInst{IrOp::load, no_block, no_value, no_value, node.var()}));
+                    m_frames.pop_back();
+                    continue;
+                }
+
+                const bool rhs_first = need_of(expr, node.rhs) > need_of(expr, node.lhs);
+                if (frame.stage < 2) {
+                    const NodeId operand = (frame.stage == 0) == rhs_first ? node.rhs : node.lhs;
+                    frame.stage++;
+                    m_frames.push_back(Frame{operand, 0});
+                    continue;
+                }
+                const ValueId second = m_results.back();
+                m_results.pop_back();
+                const ValueId first = m_results.back();
+                m_results.pop_back();
+                const ValueId lhs = rhs_first ? second : first;
+                const ValueId rhs = rhs_first ? first : second;
+                m_results.push_back(m_ir.append(m_current, IrInst{binary_op(node.kind), no_block, lhs, rhs, 0}));
+                m_frames.pop_back();
+            }
+            return m_results.back();
+        }
+
+        // need(n): how many intermediate values evaluating n keeps live at
+        // once. Leaves need none: constants become immediates or are
+        // rematerialized, and variables are already live.
+        void compute_need(ExprRange expr) {
+            m_need.resize(expr.end - expr.begin);
+            for (NodeId id = expr.begin; id < expr.end; id++) {
+                const NodeExpr& node = m_program.exprs[id];
+                uint8_t need = 0;
+                if (!node.is_leaf()) {
+                    const uint8_t l = need_of(expr, node.lhs);
+                    const uint8_t r = need_of(expr, node.rhs);
+                    need = l == r ? static_cast<uint8_t>(std::min(l + 1, 255)) : std::max(l, r);
+                }
+                m_need[id - expr.begin] = need;
+            }
+        }
+
+        uint8_t need_of(ExprRange expr, NodeId id) const {
+            return m_need[id - expr.begin];
+        }
+};
@@ -1,33 +1,130 @@
+#include <charconv>
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
 
 #include "tokenization.hpp"
 #include "parser.hpp"
+#include "binder.hpp"
+#include "fold.hpp"
+#include "ir.hpp"
+#include "passes.hpp"
 #include "generation.hpp"
+#include "peephole.hpp"
 
 int main(int argc, char* argv[]) {
+    const char* path = nullptr;
+    bool peephole_stats = false;
+    PassOptions options;
+    OptLevel level = OptLevel::O2;
+    const CostModel* costs = &apple_m1;
+    size_t registers = RegisterAllocator::pool.size();
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--peephole-stats") {
+            peephole_stats = true;
+        } else if (arg == "--gvn-stats") {
+            options.gvn_stats = true;
+        } else if (arg == "--time-passes") {
+            options.time_passes = true;
+        } else if (arg.starts_with("--print-after=")) {
+            options.print_after = arg.substr(14);
+            if (!is_pass_name(options.print_after)) {
+                std::cerr << "Error: unknown pass '" << options.print_after
+                          << "' (build-ir, mem2reg, sccp, gvn, dce)" << std::endl;
+                return 1;
+            }
+        } else if (arg.starts_with("-O")) {
+            const std::optional<OptLevel> parsed = parse_opt_level(arg);
+            if (!parsed) {
+                std::cerr << "Error: unknown optimization level '" << arg << "'" << std::endl;
+                return 1;
+            }
+            level = *parsed;
+        } else if (arg.starts_with("--cpu=")) {
+            costs = find_cost_model(arg.substr(6));
+            if (costs == nullptr) {
+                std::cerr << "Error: unknown cpu '" << arg.substr(6) << "'" << std::endl;
+                return 1;
+            }
+        } else if (arg.starts_with("--registers=")) {
+            // Fewer registers than the target has, to exercise spill code
+            const std::string_view count = arg.substr(12);
+            if (std::from_chars(count.data(), count.data() + count.size(), registers).ec != std::errc() ||
+                registers > RegisterAllocator::pool.size()) {
+                std::cerr << "Error: --registers takes 0 to " << RegisterAllocator::pool.size() << std::endl;
+                return 1;
+            }
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr) {
+        std::cerr << "Usage: hydro [-O0|-O1|-O2|-Os] [--time-passes] [--print-after=<pass>] "
+                     "[--peephole-stats] [--gvn-stats] [--cpu=apple-m1|cortex-a72] [--registers=<n>] <file.hy>" << std::endl;
+        return 1;
+    }
+
+    // Read the file straight into one buffer (a stringstream would hold a
+    // second copy of it while converting to std::string)
     std::string contents;
     {
-        std::stringstream contents_stream;
-        std::fstream input(argv[1]);
-        contents_stream << input.rdbuf();
-        contents = contents_stream.str();
+        std::ifstream input(path, std::ios::binary | std::ios::ate);
+        if (!input) {
+            std::cerr << "Error: could not open " << path << std::endl;
+            return 1;
+        }
+        contents.resize(static_cast<size_t>(input.tellg()));
+        input.seekg(0);
+        input.read(contents.data(), static_cast<std::streamsize>(contents.size()));
     }
 
-    Tokenizer tokenizer(std::move(contents));
-    std::vector<Token> tokens = tokenizer.tokenize();
+    // Strength reduction weighs instruction counts instead of latencies
+    if (level == OptLevel::Os) {
+        costs = &code_size;
+    }
+    PassManager passes(level, options, std::cerr);
 
-    Parser parser(std::move(tokens));
-    NodeProgram program = parser.parse();
+    // Tokens and AST nodes view `contents`, so it must outlive code generation
+    Tokenizer tokenizer(contents);
+    TokenStream tokens(tokenizer);
+
+    Parser parser(tokens, contents);
+    NodeProgram program = passes.time("parse", [&] { return parser.parse(); });
+
+    Binder binder(program, tokenizer);
+    if (!passes.time("bind", [&] { return binder.bind(); })) {
+        return 1;
+    }
+
+    // Runs at every level: it is what reports division by a constant zero
+    ConstantFolder folder(program, tokenizer);
+    if (!passes.time("fold", [&] { return folder.fold(); })) {
+        return 1;
+    }
+
+    IrProgram ir = passes.time("build-ir", [&] { return IrBuilder(program).build(); });
+    passes.run(ir);
+
+    Generator generator(ir, *costs, registers);
+    std::vector<Instr> code = passes.time("codegen", [&] { return generator.generate_program(); });
+
+    if (level != OptLevel::O0) {
+        Peephole peephole;
+        passes.time("peephole", [&] { peephole.run(code); });
+        if (peephole_stats) {
+            peephole.report(std::cerr);
+        }
+    }
 
-    Generator generator(program);
-    std::string asm_code = generator.generate_program();
+    Emitter out(contents.size() * 4);
+    passes.time("emit", [&] { write_program(out, code); });
+    std::string_view asm_code = out.view();
     {
         std::fstream file("out.s", std::ios::out | std::ios::trunc);
-        file << asm_code;
+        file.write(asm_code.data(), static_cast<std::streamsize>(asm_code.size()));
     }
+    passes.report();
 
     int assemble_status = system("as -o out.o out.s");
     int link_status = system("ld -arch arm64 -o out_exec out.o -lSystem -syslibroot `xcrun --show-sdk-path` -e _main");
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "dominators.hpp"
+#include "ir.hpp"
+
+// Promotes variable slots to SSA values (Cytron et al., "Efficiently
+// Computing Static Single Assignment Form").
+//
+// Every slot gets a phi at the iterated dominance frontier of the blocks
+// that store to it, but only at the joins where it is live on entry (pruned
+// SSA): a variable gets no phis at the joins after its scope has ended. A
+// walk down the dominator tree then keeps the value each slot currently
+// holds in a table indexed by slot, saving the value it replaces on an undo
+// log as the Binder does for names: a store sets the slot's value, a load
+// is replaced by it, and leaving a block's subtree unwinds the log. Each
+// block passes the values it ends with to the phis of its successors.
+//
+// Afterwards no reachable block loads or stores a slot. A slot read where
+// nothing was stored reads undef. Phis that nothing reads are deleted again.
+class Mem2Reg {
+    public:
+        inline Mem2Reg(IrProgram& program, const DominatorTree& tree)
+            : m_program(program), m_tree(tree) {}
+
+        // Returns the number of loads and stores promoted
+        size_t run() {
+            const DominatorTree& tree = m_tree;
+            // Created up front, so that no instruction is added while
+            // the walk holds references into the tables
+            m_undef = m_program.add_value(IrInst{IrOp::undef, m_program.entry, no_value, no_value, 0});
+            place_phis(tree);
+            rename(tree);
+            rewrite_operands(tree);
+            remove_dead_phis(tree);
+            return m_promoted;
+        }
+
+    private:
+        IrProgram& m_program;
+        const DominatorTree& m_tree;
+        size_t m_promoted = 0;
+        std::vector<uint32_t> m_phi_slot;       // by value; no_slot unless a phi placed here
+        std::vector<ValueId> m_replacement;     // by value: what a deleted load read
+        ValueId m_undef = no_value;
+
+        static constexpr uint32_t no_slot = UINT32_MAX;
+
+        void place_phis(const DominatorTree& tree) {
+            const size_t block_count = m_program.blocks.size();
+            // The reachable blocks that store to each slot, and those that
+            // load it before storing it
+            std::vector<std::vector<BlockId>> def_blocks(m_program.slot_count);
+            std::vector<std::vector<BlockId>> use_blocks(m_program.slot_count);
+            for (BlockId block : tree.order()) {
+                for (ValueId id : m_program.blocks[block].insts) {
+                    const IrInst& inst = m_program.values[id];
+                    if (inst.op == IrOp::store) {
+                        std::vector<BlockId>& blocks = def_blocks[inst.imm];
+                        if (blocks.empty() || blocks.back() != block) {
+                            blocks.push_back(block);
+                        }
+                    } else if (inst.op == IrOp::load) {
+                        const std::vector<BlockId>& defs = def_blocks[inst.imm];
+                        std::vector<BlockId>& uses = use_blocks[inst.imm];
+                        if ((defs.empty() || defs.back() != block) && (uses.empty() || uses.back() != block)) {
+                            uses.push_back(block);
+                        }
+                    }
+                }
+            }
+
+            const std::vector<std::vector<BlockId>> frontier = tree.frontiers();
+            // Per block, the last slot that was live on entry to it, stored
+            // in it, given a phi there or queued there
+            std::vector<uint32_t> live_in(block_count, no_slot);
+            std::vector<uint32_t> defines(block_count, no_slot);
+            std::vector<uint32_t> has_phi(block_count, no_slot);
+            std::vector<uint32_t> queued(block_count, no_slot);
+            std::vector<std::vector<ValueId>> new_phis(block_count);
+            std::vector<BlockId> work;
+            for (uint32_t slot = 0; slot < m_program.slot_count; slot++) {
+                if (use_blocks[slot].empty()) {
+                    continue;
+                }
+                mark_live_in(slot, use_blocks[slot], def_blocks[slot], live_in, defines, work);
+                for (BlockId block : def_blocks[slot]) {
+                    queued[block] = slot;
+                    work.push_back(block);
+                }
+                while (!work.empty()) {
+                    const BlockId block = work.back();
+                    work.pop_back();
+                    for (BlockId join : frontier[block]) {
+                        if (has_phi[join] == slot || live_in[join] != slot) {
+                            continue;
+                        }
+                        has_phi[join] = slot;
+                        new_phis[join].push_back(add_phi(join, slot));
+                        if (queued[join] != slot) {
+                            queued[join] = slot;
+                            work.push_back(join);
+                        }
+                    }
+                }
+            }
+            for (BlockId block = 0; block < block_count; block++) {
+                if (!new_phis[block].empty()) {
+                    std::vector<ValueId>& insts = m_program.blocks[block].insts;
+                    insts.insert(insts.begin(), new_phis[block].begin(), new_phis[block].end());
+                }
+            }
+        }
+
+        // Sets live_in[b] = slot for the blocks `slot` is live on entry to:
+        // walking back from the blocks that load it before storing it, up
+        // to the blocks that store it
+        void mark_live_in(uint32_t slot, const std::vector<BlockId>& uses, const std::vector<BlockId>& defs,
+                          std::vector<uint32_t>& live_in, std::vector<uint32_t>& defines,
+                          std::vector<BlockId>& work) const {
+            for (BlockId block : defs) {
+                defines[block] = slot;
+            }
+            for (BlockId block : uses) {
+                live_in[block] = slot;
+                work.push_back(block);
+            }
+            while (!work.empty()) {
+                const BlockId block = work.back();
+                work.pop_back();
+                for (BlockId pred : m_program.blocks[block].preds) {
+                    if (live_in[pred] != slot && defines[pred] != slot && m_tree.reachable(pred)) {
+                        live_in[pred] = slot;
+                        work.push_back(pred);
+                    }
+                }
+            }
+        }
+
+        ValueId add_phi(BlockId block, uint32_t slot) {
+            const uint32_t arg_count = static_cast<uint32_t>(m_program.blocks[block].preds.size());
+            const ValueId phi = m_program.add_value(
+                IrInst{IrOp::phi, block, static_cast<ValueId>(m_program.phi_args.size()), arg_count, 0});
+            m_program.phi_args.resize(m_program.phi_args.size() + arg_count, no_value);
+            m_phi_slot.resize(m_program.values.size(), no_slot);
+            m_phi_slot[phi] = slot;
+            return phi;
+        }
+
+        uint32_t phi_slot(ValueId id) const {
+            return id < m_phi_slot.size() ? m_phi_slot[id] : no_slot;
+        }
+
+        void rename(const DominatorTree& tree) {
+            struct Shadowed {
+                uint32_t slot;
+                ValueId previous;
+            };
+            std::vector<ValueId> current(m_program.slot_count, no_value);
+            std::vector<Shadowed> undo;
+            auto set = [&](uint32_t slot, ValueId value) {
+                undo.push_back(Shadowed{slot, current[slot]});
+                current[slot] = value;
+            };
+            auto value_of = [&](uint32_t slot) {
+                return current[slot] != no_value ? current[slot] : m_undef;
+            };
+            m_replacement.assign(m_program.values.size(), no_value);
+
+            // Block, undo log mark, next child; the tree is as deep as the
+            // if nesting, so no recursion
+            struct Frame {
+                BlockId block;
+                size_t mark;
+                size_t next;
+            };
+            std::vector<Frame> stack;
+            stack.push_back(Frame{m_program.entry, 0, 0});
+            enter(stack.back().block, set, value_of);
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                const std::vector<BlockId>& children = tree.children(frame.block);
+                if (frame.next == children.size()) {
+                    while (undo.size() > frame.mark) {
+                        current[undo.back().slot] = undo.back().previous;
+                        undo.pop_back();
+                    }
+                    stack.pop_back();
+                    continue;
+                }
+                const BlockId child = children[frame.next++];
+                stack.push_back(Frame{child, undo.size(), 0});
+                enter(child, set, value_of);
+            }
+        }
+
+        template <typename Set, typename ValueOf>
+        void enter(BlockId block_id, Set& set, ValueOf& value_of) {
+            IrBlock& block = m_program.blocks[block_id];
+            size_t kept = 0;
+            for (ValueId id : block.insts) {
+                IrInst& inst = m_program.values[id];
+                if (inst.op == IrOp::phi && phi_slot(id) != no_slot) {
+                    set(phi_slot(id), id);
+                } else if (inst.op == IrOp::load) {
+                    m_replacement[id] = value_of(inst.imm);
+                    inst.op = IrOp::nop;
+                    m_promoted++;
+                    continue;
+                } else if (inst.op == IrOp::store) {
+                    set(inst.imm, resolve(inst.a));
+                    inst.op = IrOp::nop;
+                    m_promoted++;
+                    continue;
+                }
+                block.insts[kept++] = id;
+            }
+            block.insts.resize(kept);
+
+            for (BlockId succ : block.successors()) {
+                const IrBlock& target = m_program.blocks[succ];
+                for (size_t i = 0; i < target.preds.size(); i++) {
+                    if (target.preds[i] != block_id) {
+                        continue;
+                    }
+                    for (ValueId id : target.insts) {
+                        const IrInst& phi = m_program.values[id];
+                        if (phi.op != IrOp::phi) {
+                            break;
+                        }
+                        if (phi_slot(id) != no_slot) {
+                            m_program.phi_args[phi.a + i] = value_of(phi_slot(id));
+                        }
+                    }
+                }
+            }
+        }
+
+        ValueId resolve(ValueId id) const {
+            return id < m_replacement.size() && m_replacement[id] != no_value ? m_replacement[id] : id;
+        }
+
+        // Point every use of a deleted load at the value it read. Phi
+        // arguments from unreachable predecessors were never filled in.
+        void rewrite_operands(const DominatorTree& tree) {
+            for (BlockId block_id : tree.order()) {
+                IrBlock& block = m_program.blocks[block_id];
+                for (ValueId id : block.insts) {
+                    IrInst& inst = m_program.values[id];
+                    if (is_binary(inst.op)) {
+                        inst.a = resolve(inst.a);
+                        inst.b = resolve(inst.b);
+                    } else if (inst.op == IrOp::phi) {
+                        for (ValueId& arg : m_program.args(inst)) {
+                            arg = arg == no_value ? m_undef : resolve(arg);
+                        }
+                    }
+                }
+                if (block.value != no_value) {
+                    block.value = resolve(block.value);
+                }
+            }
+        }
+
+        void remove_dead_phis(const DominatorTree& tree) {
+            std::vector<uint32_t> uses(m_program.values.size(), 0);
+            for (BlockId block_id : tree.order()) {
+                const IrBlock& block = m_program.blocks[block_id];
+                for (ValueId id : block.insts) {
+                    m_program.for_each_operand(m_program.values[id], [&](ValueId operand) {
+                        uses[operand]++;
+                    });
+                }
+                if (block.value != no_value) {
+                    uses[block.value]++;
+                }
+            }
+
+            std::vector<ValueId> dead;
+            for (ValueId id = 0; id < m_phi_slot.size(); id++) {
+                if (m_phi_slot[id] != no_slot && uses[id] == 0) {
+                    dead.push_back(id);
+                }
+            }
+            const bool removed = !dead.empty();
+            while (!dead.empty()) {
+                const ValueId id = dead.back();
+                dead.pop_back();
+                IrInst& phi = m_program.values[id];
+                for (ValueId arg : m_program.args(phi)) {
+                    if (--uses[arg] == 0 && phi_slot(arg) != no_slot && arg != id) {
+                        dead.push_back(arg);
+                    }
+                }
+                phi.op = IrOp::nop;
+            }
+
+            // The undef value goes in the entry block if anything reads it
+            if (uses[m_undef] != 0) {
+                std::vector<ValueId>& insts = m_program.blocks[m_program.entry].insts;
+                insts.insert(insts.begin(), m_undef);
+            } else {
+                m_program.values[m_undef].op = IrOp::nop;
+            }
+            if (!removed) {
+                return;
+            }
+            for (BlockId block_id : tree.order()) {
+                std::vector<ValueId>& insts = m_program.blocks[block_id].insts;
+                std::erase_if(insts, [&](ValueId id) {
+                    return m_program.values[id].op == IrOp::nop;
+                });
+            }
+        }
+};
@@ -1,248 +1,285 @@
 #pragma once
 
-#include <variant>
+#include <charconv>
 #include <vector>
 #include <optional>
 #include <iostream>
-#include <memory>
+#include <cstdint>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include "tokenization.hpp"
 
-// Forward declarations
-struct NodeExpr;
-struct NodeStatement;
-struct NodeIfPredicate;
-
-struct NodeExprIntLit {
-    Token int_lit;
-};
-
-struct NodeExprIdent {
-    Token ident;
+// The AST is a set of flat tables owned by NodeProgram. Nodes refer to each
+// other by 32-bit index into those tables, to literals by their position in
+// the source buffer and to identifiers by interned symbol, so the whole tree
+// is a handful of contiguous arrays of plain structs.
+using NodeId = uint32_t;
+inline constexpr NodeId null_node = UINT32_MAX;
+
+// Position of a token's text in the source buffer
+struct SourceSpan {
+    uint32_t offset;
+    uint32_t length;
 };
 
-struct BinExprAdd {
-    std::shared_ptr<NodeExpr> left;
-    std::shared_ptr<NodeExpr> right;
+enum class ExprKind : uint8_t {
+    int_lit,
+    ident,
+    add,
+    sub,
+    mul,
+    div,
+    // Comparisons of the unsigned 32-bit values, giving 0 or 1
+    eq,
+    ne,
+    lt,
+    le,
+    gt,
+    ge,
 };
 
-struct BinExprMul {
-    std::shared_ptr<NodeExpr> left;
-    std::shared_ptr<NodeExpr> right;
-};
+inline bool is_comparison(ExprKind kind) {
+    return kind >= ExprKind::eq;
+}
 
-struct BinExprDiv {
-    std::shared_ptr<NodeExpr> left;
-    std::shared_ptr<NodeExpr> right;
-};
+// Expression nodes are appended in post-order: both operands of a binary node
+// come before it, and every expression occupies one contiguous run of the
+// table ending at its root. The folder and IrBuilder can therefore visit an
+// expression's nodes by walking its run front to back.
+struct NodeExpr {
+    ExprKind kind;
+    // Binary nodes: index of the left operand. Leaves: source offset.
+    uint32_t lhs;
+    // Binary nodes: index of the right operand. int_lit: the value.
+    // ident: the variable (see var()).
+    uint32_t rhs;
+
+    bool is_leaf() const {
+        return kind == ExprKind::int_lit || kind == ExprKind::ident;
+    }
 
-struct BinExprSub {
-    std::shared_ptr<NodeExpr> left;
-    std::shared_ptr<NodeExpr> right;
-};
+    // int_lit only: the literal's value as a 32-bit register sees it
+    uint32_t value() const {
+        return rhs;
+    }
 
-struct BinExpr {
-    std::variant<BinExprAdd, BinExprMul, BinExprDiv, BinExprSub> var;
-};  
+    static NodeExpr constant(uint32_t offset, uint32_t value) {
+        return NodeExpr{ExprKind::int_lit, offset, value};
+    }
 
-struct NodeExpr {
-    std::variant<NodeExprIntLit, NodeExprIdent, BinExpr> var;
+    // ident only: the SymbolId as parsed, the variable's slot once bound
+    uint32_t var() const {
+        return rhs;
+    }
 };
 
-struct NodeStatementExit {
-    NodeExpr exit;
-};
+// The nodes [begin, end) of one expression; the root is end - 1. An empty
+// range stands for "no expression" (the condition of an else branch).
+struct ExprRange {
+    NodeId begin;
+    NodeId end;
 
-struct NodeStatementLet {
-    Token ident;
-    NodeExpr value;
-};
+    NodeId root() const {
+        return end - 1;
+    }
 
-struct NodeScope {
-    std::vector<NodeStatement> statements;
+    bool empty() const {
+        return begin == end;
+    }
 };
 
-struct NodeStatementIf {
-    NodeExpr condition;
-    NodeScope then_scope;
-    std::shared_ptr<NodeIfPredicate> predicate;
+enum class StmtKind : uint8_t {
+    exit,
+    let,
+    assign,
+    if_,
+    scope,
 };
 
-struct NodeIfPredicateElse {
-    NodeScope scope;
+struct NodeStatement {
+    StmtKind kind;
+    SourceSpan ident;          // let, assign: the variable
+    uint32_t var = no_symbol;  // let, assign: symbol as parsed, slot once bound
+    ExprRange expr;            // exit, let, assign: the value; if: the condition
+    NodeId scope = null_node;  // if: the then-scope; scope: the nested scope
+    NodeId predicate = null_node; // if: first elif/else branch
 };
 
-struct NodeIfPredicateElif {
-    NodeExpr condition;
-    NodeScope scope;
-    std::shared_ptr<NodeIfPredicate> predicate;
+// The statements of a scope are contiguous: [first, first + count)
+struct NodeScope {
+    NodeId first;
+    uint32_t count;
 };
 
+// An elif (with a condition) or else (empty condition) branch of an if
 struct NodeIfPredicate {
-    std::variant<NodeIfPredicateElse, NodeIfPredicateElif> var;
-};
+    ExprRange condition;
+    NodeId scope;
+    NodeId next = null_node;   // following elif/else branch
 
-struct NodeStatementAssign {
-    Token ident;
-    NodeExpr value;
+    bool is_else() const {
+        return condition.empty();
+    }
 };
 
-struct NodeStatement {
-    std::variant<NodeStatementExit, NodeStatementLet, NodeStatementIf, NodeIfPredicate, NodeScope, NodeStatementAssign> expr;
+// One per let statement, indexed by slot. Each let introduces a fresh slot,
+// so a shadowing declaration never shares one with the variable it hides.
+struct NodeVariable {
+    SymbolId symbol;
+    SourceSpan decl;
 };
 
+// Move-only: the tables can be large, so an accidental copy should not
+// compile.
 struct NodeProgram {
+    NodeProgram() = default;
+    NodeProgram(NodeProgram&&) = default;
+    NodeProgram& operator=(NodeProgram&&) = default;
+    NodeProgram(const NodeProgram&) = delete;
+    NodeProgram& operator=(const NodeProgram&) = delete;
+
+    std::string_view source;
+    std::vector<NodeExpr> exprs;
     std::vector<NodeStatement> statements;
-};
-
-// Symbol table for variable resolution
-class SymbolTable {
-public:
-    SymbolTable() {
-        // Start with global scope
-        m_scopes.push_back(std::unordered_map<std::string, bool>());
-    }
-
-    void enter_scope() {
-        m_scopes.push_back(std::unordered_map<std::string, bool>());
-    }
-
-    void exit_scope() {
-        if (m_scopes.size() > 1) {  // Don't pop the global scope
-            m_scopes.pop_back();
-        }
-    }
-
-    bool declare(const std::string& name) {
-        if (m_scopes.empty()) {
-            std::cerr << "Internal error: symbol table is empty" << std::endl;
-            return false;
-        }
-        
-        // Check if variable is already declared in current scope
-        if (m_scopes.back().find(name) != m_scopes.back().end()) {
-            return false;
-        }
-        
-        m_scopes.back()[name] = true;
-        return true;
-    }
-
-    bool is_declared(const std::string& name) const {
-        if (m_scopes.empty()) {
-            std::cerr << "Internal error: symbol table is empty" << std::endl;
-            return false;
-        }
-
-        // Search from innermost to outermost scope
-        for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it) {
-            if (it->find(name) != it->end()) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    // Check if a variable is accessible in the current scope
-    bool is_accessible(const std::string& name) const {
-        if (m_scopes.empty()) {
-            return false;
-        }
+    std::vector<NodeScope> scopes;
+    std::vector<NodeIfPredicate> predicates;
+    std::vector<NodeVariable> variables;  // filled in by the Binder
+    NodeId root = null_node;   // scope holding the top-level statements
 
-        // A variable is accessible if it's declared in any scope
-        return is_declared(name);
+    std::string_view text(SourceSpan span) const {
+        return source.substr(span.offset, span.length);
     }
 
-    size_t scope_depth() const {
-        return m_scopes.size();
+    const NodeScope& root_scope() const {
+        return scopes[root];
     }
-
-private:
-    std::vector<std::unordered_map<std::string, bool>> m_scopes;
 };
 
 class Parser {
 public:
-    explicit Parser(std::vector<Token> tokens)
-        : m_tokens(std::move(tokens)), m_pos(0) {}
+    Parser(TokenStream& tokens, std::string_view source)
+        : m_tokens(tokens) {
+        m_program.source = source;
+    }
 
+    // Builds the syntax tree only; whether names are declared is checked
+    // afterwards by the Binder
     NodeProgram parse() {
-        NodeProgram program;
-        m_symbols.enter_scope();  // Enter global scope
-        
-        if (!parse_statements(program.statements, true)) {
-            m_symbols.exit_scope();
-            return program;
-        }
-        
-        m_symbols.exit_scope();  // Exit global scope
-        return program;
+        parse_statements(true);
+        // The program scope finishes last, so it is the last scope stored
+        // (even when parsing stopped early on an error)
+        m_program.root = static_cast<NodeId>(m_program.scopes.size() - 1);
+        return std::move(m_program);
     }
 
 private:
-    std::vector<Token> m_tokens;
-    size_t m_pos;
-    SymbolTable m_symbols;
+    TokenStream& m_tokens;
+    NodeProgram m_program;
+    // Statements of the scopes currently being parsed, innermost last. A
+    // scope's statements move to m_program.statements as one block once the
+    // scope is complete, which keeps each scope contiguous.
+    std::vector<NodeStatement> m_pending;
     
     std::unordered_map<TokenType, int> m_precedence = {
-        {TokenType::plus, 1},
-        {TokenType::minus, 1},
-        {TokenType::star, 2},
-        {TokenType::slash, 2}
+        {TokenType::eq_eq, 1},
+        {TokenType::not_eq_, 1},
+        {TokenType::less, 2},
+        {TokenType::less_eq, 2},
+        {TokenType::greater, 2},
+        {TokenType::greater_eq, 2},
+        {TokenType::plus, 3},
+        {TokenType::minus, 3},
+        {TokenType::star, 4},
+        {TokenType::slash, 4}
     };
 
     // Helper method for error reporting
     void report_error(const std::string& message, const Token& token) {
-        std::cerr << "Error at line " << token.line << ", column " << token.column << ": " << message << std::endl;
+        report_error(message, token.value);
+    }
+
+    void report_error(const std::string& message, std::string_view at) {
+        SourceLocation loc = m_tokens.locate(at);
+        std::cerr << "Error at line " << loc.line << ", column " << loc.column << ": " << message << std::endl;
     }
 
-    bool parse_statements(std::vector<NodeStatement>& statements, bool is_program_scope = false) {
-        while (auto token = peek()) {
-            if (token->type == TokenType::close_brace) {
+    // Empty view just past the last character, for errors at end of input
+    std::string_view end_of_input() const {
+        return m_program.source.substr(m_program.source.size());
+    }
+
+    SourceSpan span_of(const Token& token) const {
+        return SourceSpan{static_cast<uint32_t>(token.value.data() - m_program.source.data()),
+                          static_cast<uint32_t>(token.value.size())};
+    }
+
+    // Parse statements up to the closing '}' (or the end of input for the
+    // program scope) and store them as a new scope. Statements parsed before
+    // an error are kept.
+    NodeId parse_statements(bool is_program_scope = false) {
+        const size_t mark = m_pending.size();
+        bool ok = parse_statement_list(is_program_scope);
+
+        NodeScope scope{static_cast<NodeId>(m_program.statements.size()),
+                        static_cast<uint32_t>(m_pending.size() - mark)};
+        m_program.statements.insert(m_program.statements.end(), m_pending.begin() + mark, m_pending.end());
+        m_pending.resize(mark);
+        m_program.scopes.push_back(scope);
+        NodeId id = static_cast<NodeId>(m_program.scopes.size() - 1);
+        return ok ? id : null_node;
+    }
+
+    bool parse_statement_list(bool is_program_scope) {
+        while (const Token* next = peek()) {
+            // Copied: parsing the statement moves the window past it
+            const Token token = *next;
+            if (token.type == TokenType::close_brace) {
                 return true;  // End of scope
             }
             
             bool statement_parsed = false;
-            if (token->type == TokenType::_exit) {
-                statement_parsed = parse_exit_statement(statements);
+            if (token.type == TokenType::_exit) {
+                statement_parsed = parse_exit_statement();
                 if (statement_parsed) {
                     // Expect semicolon after exit statement
                     if (!consume_expected(TokenType::semi)) {
-                        report_error("expected ';' after exit statement", *token);
+                        report_error("expected ';' after exit statement", token);
                         return false;
                     }
                 }
-            } else if (token->type == TokenType::let) {
-                statement_parsed = parse_let_statement(statements);
+            } else if (token.type == TokenType::let) {
+                statement_parsed = parse_let_statement();
                 if (!statement_parsed) {
                     return false;
                 }
-            } else if (token->type == TokenType::if_) {
-                statement_parsed = parse_if_statement(statements);
+            } else if (token.type == TokenType::if_) {
+                statement_parsed = parse_if_statement();
                 if (!statement_parsed) {
                     return false;
                 }
-            } else if (token->type == TokenType::open_brace) {
-                auto nested_scope = parse_scope();
-                if (nested_scope.has_value()) {
-                    statements.push_back(NodeStatement{*nested_scope});
+            } else if (token.type == TokenType::open_brace) {
+                consume(); // consume '{'
+                NodeId nested_scope = parse_scope();
+                if (nested_scope != null_node) {
+                    m_pending.push_back(NodeStatement{StmtKind::scope, {}, no_symbol, {}, nested_scope});
                     statement_parsed = true;
                 } else {
                     return false;
                 }
-            } else if (token->type == TokenType::ident) {
-                statement_parsed = parse_assign_statement(statements);
+            } else if (token.type == TokenType::ident) {
+                statement_parsed = parse_assign_statement();
                 if (!statement_parsed) {
                     return false;
                 }
-            } else if (token->type == TokenType::semi) {
+            } else if (token.type == TokenType::semi) {
                 // Skip standalone semicolons
                 consume();
                 statement_parsed = true;
             }
 
             if (!statement_parsed) {
-                report_error("unexpected token '" + token->value + "' in scope", *token);
+                report_error("unexpected token '" + std::string(token.value) + "' in scope", token);
                 return false;
             }
         }
@@ -252,31 +289,27 @@ private:
             return true;
         }
         
-        report_error("expected '}' to close scope", peek().value());
+        report_error("expected '}' to close scope", end_of_input());
         return false;
     }
 
-    std::optional<NodeScope> parse_scope() {
-        m_symbols.enter_scope();  // Enter new scope
-        NodeScope scope;
-        
-        if (!parse_statements(scope.statements)) {
-            m_symbols.exit_scope();  // Exit scope on error
-            return std::nullopt;
+    NodeId parse_scope() {
+        NodeId scope = parse_statements();
+        if (scope == null_node) {
+            return null_node;
         }
         
         consume(); // consume '}'
-        m_symbols.exit_scope();  // Exit scope
         return scope;
     }
 
-    bool parse_exit_statement(std::vector<NodeStatement>& statements) {
-        auto exit_token = *consume(); // consume 'exit'
+    bool parse_exit_statement() {
+        const Token exit_token = *consume(); // consume 'exit'
         if (!consume_expected(TokenType::open_paren)) {
             report_error("expected '(' after exit keyword", exit_token);
             return false;
         }
-        auto expr = parse_expr();
+        auto expr = parse_expression();
         if (!expr.has_value()) {
             report_error("expected expression in exit statement", exit_token);
             return false;
@@ -285,50 +318,44 @@ private:
             report_error("expected ')' after expression in exit statement", exit_token);
             return false;
         }
-        NodeStatementExit exit_stmt{*expr};
-        statements.push_back(NodeStatement{exit_stmt});
+        m_pending.push_back(NodeStatement{StmtKind::exit, {}, no_symbol, *expr});
         return true;
     }
 
-    bool parse_let_statement(std::vector<NodeStatement>& statements) {
-        auto let_token = *consume(); // consume 'let'
-        auto ident_token = consume_expected(TokenType::ident);
-        if (!ident_token.has_value()) {
+    bool parse_let_statement() {
+        const Token let_token = *consume(); // consume 'let'
+        const Token* ident_next = consume_expected(TokenType::ident);
+        if (!ident_next) {
             report_error("expected identifier after 'let'", let_token);
             return false;
         }
-        
-        // Check if variable is already declared in current scope
-        if (!m_symbols.declare(ident_token->value)) {
-            report_error("variable '" + ident_token->value + "' already declared in this scope", *ident_token);
-            return false;
-        }
+        const Token ident_token = *ident_next;
+
 
         if (!consume_expected(TokenType::eq)) {
-            report_error("expected '=' after identifier in let statement", *ident_token);
+            report_error("expected '=' after identifier in let statement", ident_token);
             return false;
         }
-        auto expr = parse_expr();
+        auto expr = parse_expression();
         if (!expr.has_value()) {
-            report_error("expected expression after '=' in let statement", *ident_token);
+            report_error("expected expression after '=' in let statement", ident_token);
             return false;
         }
         if (!consume_expected(TokenType::semi)) {
-            report_error("expected ';' after let statement", *ident_token);
+            report_error("expected ';' after let statement", ident_token);
             return false;
         }
-        NodeStatementLet let_stmt{*ident_token, *expr};
-        statements.push_back(NodeStatement{let_stmt});
+        m_pending.push_back(NodeStatement{StmtKind::let, span_of(ident_token), ident_token.symbol, *expr});
         return true;
     }
 
-    bool parse_if_statement(std::vector<NodeStatement>& statements) {
-        auto if_token = *consume(); // consume 'if'
+    bool parse_if_statement() {
+        const Token if_token = *consume(); // consume 'if'
         if (!consume_expected(TokenType::open_paren)) {
             report_error("expected '(' after if keyword", if_token);
             return false;
         }
-        auto condition = parse_expr();
+        auto condition = parse_expression();
         if (!condition.has_value()) {
             report_error("expected condition in if statement", if_token);
             return false;
@@ -341,111 +368,106 @@ private:
             report_error("expected '{' after if condition", if_token);
             return false;
         }
-        auto then_scope = parse_scope();
-        if (!then_scope.has_value()) {
+        NodeId then_scope = parse_scope();
+        if (then_scope == null_node) {
             report_error("expected scope after if condition", if_token);
             return false;
         }
-        auto predicate = parse_predicate();
-        NodeStatementIf if_stmt{*condition, *then_scope, predicate};
-        statements.push_back(NodeStatement{if_stmt});
+        NodeId predicate = parse_predicate();
+        m_pending.push_back(NodeStatement{StmtKind::if_, {}, no_symbol, *condition, then_scope, predicate});
         return true;
     }
 
-    std::shared_ptr<NodeIfPredicate> parse_predicate() {
-        if (peek()->type == TokenType::elif) {
-            auto elif_token = *consume(); // consume 'elif'
+    NodeId parse_predicate() {
+        const Token* next = peek();
+        if (next && next->type == TokenType::elif) {
+            const Token elif_token = *consume(); // consume 'elif'
             if (!consume_expected(TokenType::open_paren)) {
                 report_error("expected '(' after elif keyword", elif_token);
-                return nullptr;
+                return null_node;
             }
-            auto condition = parse_expr();
+            auto condition = parse_expression();
             if (!condition.has_value()) {
                 report_error("expected condition in elif predicate", elif_token);
-                return nullptr;
+                return null_node;
             }
             if (!consume_expected(TokenType::close_paren)) {
                 report_error("expected ')' after elif predicate", elif_token);
-                return nullptr;
+                return null_node;
             }
             if (!consume_expected(TokenType::open_brace)) {
                 report_error("expected '{' after elif predicate", elif_token);
-                return nullptr;
+                return null_node;
             }
-            auto elif_scope = parse_scope();
-            if (!elif_scope.has_value()) {
+            NodeId elif_scope = parse_scope();
+            if (elif_scope == null_node) {
                 report_error("expected scope after elif predicate", elif_token);
-                return nullptr;
+                return null_node;
             }
-            auto next_predicate = parse_predicate();
-            return std::make_shared<NodeIfPredicate>(NodeIfPredicateElif{*condition, *elif_scope, next_predicate});
-        } else if (peek()->type == TokenType::else_) {
-            auto else_token = *consume(); // consume 'else'
+            NodeId next_predicate = parse_predicate();
+            return add_predicate(NodeIfPredicate{*condition, elif_scope, next_predicate});
+        } else if (next && next->type == TokenType::else_) {
+            const Token else_token = *consume(); // consume 'else'
             if (!consume_expected(TokenType::open_brace)) {
                 report_error("expected '{' after else keyword", else_token);
-                return nullptr;
+                return null_node;
             }
-            auto else_scope = parse_scope();
-            if (!else_scope.has_value()) {
+            NodeId else_scope = parse_scope();
+            if (else_scope == null_node) {
                 report_error("expected scope after else predicate", else_token);
-                return nullptr;
+                return null_node;
             }
-            return std::make_shared<NodeIfPredicate>(NodeIfPredicateElse{*else_scope});
+            return add_predicate(NodeIfPredicate{ExprRange{0, 0}, else_scope});
         }
-        return nullptr; // No elif or else
+        return null_node; // No elif or else
     }
 
-    bool parse_assign_statement(std::vector<NodeStatement>& statements) {
-        auto ident_token = consume_expected(TokenType::ident);
-        if (!ident_token.has_value()) {
-            report_error("expected identifier in assignment", peek().value());
-            return false;
-        }
+    NodeId add_predicate(const NodeIfPredicate& predicate) {
+        m_program.predicates.push_back(predicate);
+        return static_cast<NodeId>(m_program.predicates.size() - 1);
+    }
 
-        // Check if variable exists in any scope
-        if (!m_symbols.is_declared(ident_token->value)) {
-            report_error("variable '" + ident_token->value + "' is not declared", *ident_token);
+    bool parse_assign_statement() {
+        const Token* ident_next = consume_expected(TokenType::ident);
+        if (!ident_next) {
+            report_error("expected identifier in assignment", end_of_input());
             return false;
         }
+        const Token ident_token = *ident_next;
 
         if (!consume_expected(TokenType::eq)) {
-            report_error("expected '=' after identifier in assign statement", *ident_token);
+            report_error("expected '=' after identifier in assign statement", ident_token);
             return false;
         }
-        auto expr = parse_expr();
+        auto expr = parse_expression();
         if (!expr.has_value()) {
-            report_error("expected expression after '=' in assign statement", *ident_token);
+            report_error("expected expression after '=' in assign statement", ident_token);
             return false;
         }
         if (!consume_expected(TokenType::semi)) {
-            report_error("expected ';' after assign statement", *ident_token);
+            report_error("expected ';' after assign statement", ident_token);
             return false;
         }
-        NodeStatementAssign assign_stmt{*ident_token, *expr};
-        statements.push_back(NodeStatement{assign_stmt});
+        m_pending.push_back(NodeStatement{StmtKind::assign, span_of(ident_token), ident_token.symbol, *expr});
         return true;
     }
     
-    std::optional<Token> peek(size_t offset = 0) const {
-        if (m_pos + offset < m_tokens.size()) {
-            return m_tokens[m_pos + offset];
-        }
-        return std::nullopt;
+    // Tokens are handed out by reference into the stream's lookahead window
+    // (see TokenStream::peek for how long they stay valid)
+    const Token* peek(size_t offset = 0) {
+        return m_tokens.peek(offset);
     }
 
-    std::optional<Token> consume() {
-        if (m_pos < m_tokens.size()) {
-            return m_tokens[m_pos++];
-        }
-        return std::nullopt;
+    const Token* consume() {
+        return m_tokens.consume();
     }
 
-    std::optional<Token> consume_expected(TokenType expected_type) {
-        auto token = consume();
+    const Token* consume_expected(TokenType expected_type) {
+        const Token* token = consume();
         if (token && token->type == expected_type) {
             return token;
         }
-        return std::nullopt;
+        return nullptr;
     }
 
     int get_precedence(TokenType type) {
@@ -456,56 +478,68 @@ private:
         return 0; // Default precedence for non-operators
     }
 
-    // Parse primary expressions (numbers, identifiers, parentheses)
-    std::optional<NodeExpr> parse_primary() {
-        auto token = peek();
-        if (!token.has_value()) {
+    NodeId add_expr(ExprKind kind, uint32_t lhs, uint32_t rhs) {
+        m_program.exprs.push_back(NodeExpr{kind, lhs, rhs});
+        return static_cast<NodeId>(m_program.exprs.size() - 1);
+    }
+
+    // Parse a full expression and return the range of nodes it occupies
+    std::optional<ExprRange> parse_expression() {
+        const NodeId begin = static_cast<NodeId>(m_program.exprs.size());
+        NodeId root = parse_expr();
+        if (root == null_node) {
             return std::nullopt;
         }
+        return ExprRange{begin, root + 1};
+    }
+
+    // Parse primary expressions (numbers, identifiers, parentheses)
+    NodeId parse_primary() {
+        const Token* token = peek();
+        if (!token) {
+            return null_node;
+        }
 
         if (token->type == TokenType::int_lit) {
-            consume();
-            NodeExpr expr;
-            expr.var = NodeExprIntLit{*token};
-            return expr;
-        } else if (token->type == TokenType::ident) {
-            // Check if variable is accessible in current scope
-            if (!m_symbols.is_accessible(token->value)) {
-                report_error("variable '" + token->value + "' is not declared", *token);
-                return std::nullopt;
+            const Token& literal = *consume();
+            uint32_t value = 0;
+            if (std::from_chars(literal.value.data(), literal.value.data() + literal.value.size(), value).ec != std::errc()) {
+                report_error("integer literal '" + std::string(literal.value) + "' does not fit in 32 bits", literal);
+                return null_node;
             }
-            consume();
-            NodeExpr expr;
-            expr.var = NodeExprIdent{*token};
-            return expr;
+            return add_expr(ExprKind::int_lit, span_of(literal).offset, value);
+        } else if (token->type == TokenType::ident) {
+            const Token& ident = *consume();
+            return add_expr(ExprKind::ident, span_of(ident).offset, ident.symbol);
         } else if (token->type == TokenType::open_paren) {
-            consume(); // consume '('
-            auto expr = parse_expr();
-            if (!expr.has_value()) {
-                report_error("expected expression after '('", *token);
-                return std::nullopt;
+            const Token open_paren = *consume(); // consume '('
+            NodeId expr = parse_expr();
+            if (expr == null_node) {
+                report_error("expected expression after '('", open_paren);
+                return null_node;
             }
             if (!consume_expected(TokenType::close_paren)) {
-                report_error("expected ')' after expression", *token);
-                return std::nullopt;
+                report_error("expected ')' after expression", open_paren);
+                return null_node;
             }
             return expr;
         }
 
-        report_error("unexpected token '" + token->value + "' in expression", *token);
-        return std::nullopt;
+        report_error("unexpected token '" + std::string(token->value) + "' in expression", *token);
+        return null_node;
     }
 
-    // Precedence climbing expression parser
-    std::optional<NodeExpr> parse_expr(int min_precedence = 0) {
-        auto left = parse_primary();
-        if (!left.has_value()) {
-            return std::nullopt;
+    // Precedence climbing expression parser. Operands are parsed before the
+    // node combining them is added, which is what keeps the table post-order.
+    NodeId parse_expr(int min_precedence = 0) {
+        NodeId left = parse_primary();
+        if (left == null_node) {
+            return null_node;
         }
 
         while (true) {
-            auto op_token = peek();
-            if (!op_token.has_value()) {
+            const Token* op_token = peek();
+            if (!op_token) {
                 break; // End of input
             }
 
@@ -514,49 +548,37 @@ private:
                 break; // Not an operator or precedence too low
             }
 
-            auto op = consume(); // consume the operator
-            auto right = parse_expr(precedence + 1);
-            if (!right.has_value()) {
-                std::cerr << "Parse error: expected expression after operator '" << op->value << "'" << std::endl;
-                return std::nullopt;
+            const Token op = *consume(); // consume the operator
+            NodeId right = parse_expr(precedence + 1);
+            if (right == null_node) {
+                std::cerr << "Parse error: expected expression after operator '" << op.value << "'" << std::endl;
+                return null_node;
             }
 
             // Create binary expression based on operator type
-            if (op->type == TokenType::plus) {
-                BinExprAdd add_expr{
-                    std::make_shared<NodeExpr>(*left),
-                    std::make_shared<NodeExpr>(*right)
-                };
-                NodeExpr new_expr;
-                new_expr.var = BinExpr{add_expr};
-                left = new_expr;
-            } else if (op->type == TokenType::minus) {
-                BinExprSub sub_expr{
-                    std::make_shared<NodeExpr>(*left),
-                    std::make_shared<NodeExpr>(*right)
-                };
-                NodeExpr new_expr;
-                new_expr.var = BinExpr{sub_expr};
-                left = new_expr;
-            } else if (op->type == TokenType::star) {
-                BinExprMul mul_expr{
-                    std::make_shared<NodeExpr>(*left),
-                    std::make_shared<NodeExpr>(*right)
-                };
-                NodeExpr new_expr;
-                new_expr.var = BinExpr{mul_expr};
-                left = new_expr;
-            } else if (op->type == TokenType::slash) {
-                BinExprDiv div_expr{
-                    std::make_shared<NodeExpr>(*left),
-                    std::make_shared<NodeExpr>(*right)
-                };
-                NodeExpr new_expr;
-                new_expr.var = BinExpr{div_expr};
-                left = new_expr;
+            if (op.type == TokenType::plus) {
+                left = add_expr(ExprKind::add, left, right);
+            } else if (op.type == TokenType::minus) {
+                left = add_expr(ExprKind::sub, left, right);
+            } else if (op.type == TokenType::star) {
+                left = add_expr(ExprKind::mul, left, right);
+            } else if (op.type == TokenType::slash) {
+                left = add_expr(ExprKind::div, left, right);
+            } else if (op.type == TokenType::eq_eq) {
+                left = add_expr(ExprKind::eq, left, right);
+            } else if (op.type == TokenType::not_eq_) {
+                left = add_expr(ExprKind::ne, left, right);
+            } else if (op.type == TokenType::less) {
+                left = add_expr(ExprKind::lt, left, right);
+            } else if (op.type == TokenType::less_eq) {
+                left = add_expr(ExprKind::le, left, right);
+            } else if (op.type == TokenType::greater) {
+                left = add_expr(ExprKind::gt, left, right);
+            } else if (op.type == TokenType::greater_eq) {
+                left = add_expr(ExprKind::ge, left, right);
             }
         }
 
         return left;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "dce.hpp"
+#include "dominators.hpp"
+#include "gvn.hpp"
+#include "ir.hpp"
+#include "mem2reg.hpp"
+#include "sccp.hpp"
+
+enum class OptLevel : uint8_t {
+    O0,     // the IR as built: every variable in its stack slot, no peephole
+    O1,     // variables in registers, dead code removed
+    O2,     // also constants propagated and common subexpressions eliminated
+    Os,     // O2's passes, with instruction selection counting instructions
+};
+
+inline std::optional<OptLevel> parse_opt_level(std::string_view flag) {
+    static constexpr std::pair<std::string_view, OptLevel> levels[] = {
+        {"-O0", OptLevel::O0},
+        {"-O1", OptLevel::O1},
+        {"-O2", OptLevel::O2},
+        {"-Os", OptLevel::Os},
+    };
+    for (const auto& [name, level] : levels) {
+        if (name == flag) {
+            return level;
+        }
+    }
+    return std::nullopt;
+}
+
+enum class PassId : uint8_t {
+    mem2reg,
+    sccp,
+    gvn,
+    dce,
+};
+
+inline constexpr std::string_view pass_names[] = {"mem2reg", "sccp", "gvn", "dce"};
+
+// "build-ir" too, for the IR before any pass
+inline bool is_pass_name(std::string_view name) {
+    return name == "build-ir" || std::find(std::begin(pass_names), std::end(pass_names), name) != std::end(pass_names);
+}
+
+struct PassOptions {
+    bool time_passes = false;
+    bool gvn_stats = false;
+    std::string_view print_after;   // a pass name; the IR goes to the log after it
+};
+
+// Runs the IR passes an optimization level calls for, in order.
+//
+// Analyses are computed the first time a pass asks for one and kept until
+// a pass that changes the CFG invalidates them. mem2reg, sccp and gvn only
+// rewrite instructions, so at -O2 all three share one dominator tree; dce
+// folds branches and deletes and merges blocks, so it invalidates it.
+//
+// With --time-passes every pass, analysis and driver phase timed through
+// time() is recorded, and report() prints a table of wall time, IR size
+// before and after, and the number of changes each pass made, as its run()
+// counts them.
+class PassManager {
+    public:
+        inline PassManager(OptLevel level, const PassOptions& options, std::ostream& log)
+            : m_level(level), m_options(options), m_log(log) {}
+
+        void run(IrProgram& program) {
+            m_program = &program;
+            if (m_options.print_after == "build-ir") {
+                print("build-ir");
+            }
+            for (PassId pass : schedule()) {
+                run_pass(pass);
+            }
+        }
+
+        // Run a driver phase outside the IR pipeline, timed like a pass
+        template <typename F>
+        decltype(auto) time(std::string_view name, F&& phase) {
+            const auto start = std::chrono::steady_clock::now();
+            struct Record_on_exit {
+                PassManager& manager;
+                std::string_view name;
+                std::chrono::steady_clock::time_point start;
+                ~Record_on_exit() {
+                    manager.m_records.push_back(Record{name, Record::Kind::phase, elapsed_ms(start)});
+                }
+            } record{*this, name, start};
+            return phase();
+        }
+
+        void report() const {
+            if (!m_options.time_passes) {
+                return;
+            }
+            m_log << std::left << std::setw(12) << "pass" << std::right << std::setw(11) << "time (ms)"
+                  << std::setw(20) << "instructions" << std::setw(14) << "blocks" << std::setw(10) << "changes"
+                  << "\n";
+            double total = 0;
+            for (const Record& record : m_records) {
+                total += record.ms;
+                m_log << std::left << std::setw(12) << record.name << std::right << std::setw(11) << std::fixed
+                      << std::setprecision(3) << record.ms;
+                if (record.kind == Record::Kind::transform) {
+                    m_log << std::setw(20) << size_change(record.insts_before, record.insts_after)
+                          << std::setw(14) << size_change(record.blocks_before, record.blocks_after)
+                          << std::setw(10) << record.changes;
+                } else if (record.kind == Record::Kind::analysis) {
+                    m_log << "  (analysis)";
+                }
+                m_log << "\n";
+            }
+            m_log << std::left << std::setw(12) << "total" << std::right << std::setw(11) << total << "\n";
+            m_log << "dominator tree: computed " << m_analyses_computed << ", reused " << m_analyses_reused << "\n";
+        }
+
+    private:
+        struct Record {
+            enum class Kind : uint8_t {
+                phase,
+                analysis,
+                transform,
+            };
+            std::string_view name;
+            Kind kind;
+            double ms;
+            size_t insts_before = 0;
+            size_t insts_after = 0;
+            size_t blocks_before = 0;
+            size_t blocks_after = 0;
+            size_t changes = 0;
+        };
+
+        OptLevel m_level;
+        PassOptions m_options;
+        std::ostream& m_log;
+        IrProgram* m_program = nullptr;
+        std::optional<DominatorTree> m_dominators;
+        size_t m_analyses_computed = 0;
+        size_t m_analyses_reused = 0;
+        std::vector<Record> m_records;
+
+        std::span<const PassId> schedule() const {
+            static constexpr PassId o1[] = {PassId::mem2reg, PassId::dce};
+            static constexpr PassId o2[] = {PassId::mem2reg, PassId::sccp, PassId::gvn, PassId::dce};
+            switch (m_level) {
+                case OptLevel::O0:
+                    return {};
+                case OptLevel::O1:
+                    return o1;
+                case OptLevel::O2:
+                case OptLevel::Os:
+                    return o2;
+            }
+            return {};
+        }
+
+        static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        static std::string size_change(size_t before, size_t after) {
+            return std::to_string(before) + " -> " + std::to_string(after);
+        }
+
+        const DominatorTree& dominators() {
+            if (m_dominators) {
+                m_analyses_reused++;
+                return *m_dominators;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            m_dominators.emplace(*m_program);
+            m_analyses_computed++;
+            m_records.push_back(Record{"dominators", Record::Kind::analysis, elapsed_ms(start)});
+            return *m_dominators;
+        }
+
+        void run_pass(PassId pass) {
+            IrProgram& program = *m_program;
+            // Analyses are timed on their own, not as part of the pass
+            const DominatorTree* tree = pass == PassId::dce ? nullptr : &dominators();
+
+            Record record{pass_names[static_cast<int>(pass)], Record::Kind::transform, 0};
+            record.insts_before = program.instruction_count();
+            record.blocks_before = program.block_count();
+            const auto start = std::chrono::steady_clock::now();
+            switch (pass) {
+                case PassId::mem2reg:
+                    record.changes = Mem2Reg(program, *tree).run();
+                    break;
+                case PassId::sccp:
+                    record.changes = ConstantPropagator(program, *tree).run();
+                    break;
+                case PassId::gvn: {
+                    ValueNumbering numbering(program, *tree);
+                    record.changes = numbering.run();
+                    if (m_options.gvn_stats) {
+                        numbering.report(m_log);
+                    }
+                    break;
+                }
+                case PassId::dce:
+                    record.changes = DeadCodeEliminator(program).run();
+                    m_dominators.reset();
+                    break;
+            }
+            record.ms = elapsed_ms(start);
+            record.insts_after = program.instruction_count();
+            record.blocks_after = program.block_count();
+            m_records.push_back(record);
+
+            if (m_options.print_after == record.name) {
+                print(record.name);
+            }
+        }
+
+        void print(std::string_view pass) {
+            m_log << "; IR after " << pass << "\n";
+            print_ir(m_log, *m_program);
+        }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "instructions.hpp"
+
+// Peephole optimization over the generated instruction list.
+//
+// Instructions are moved one at a time from the input to the output list,
+// and after each one the patterns below are tried on the end of the output.
+// A rewrite can expose another (a forwarded load becoming a self-move that
+// is then deleted), so matching repeats until nothing fires. Rewrites only
+// touch instructions already moved over, while the question "is this
+// register dead afterwards?" is answered by scanning the untouched input
+// ahead. That scan gives up at the first label or branch, so a register is
+// only considered dead when straight-line code overwrites it, or the
+// program exits, before anything reads it.
+class Peephole {
+    public:
+        enum class Pattern : uint8_t {
+            store_load,         // str r, [sp, #o]; ldr d, [sp, #o] -> str; mov d, r
+            self_move,          // mov r, r -> (nothing)
+            immediate_operand,  // mov t, #imm; add d, n, t -> add d, n, #imm
+            move_coalesce,      // op t, ...; mov d, t -> op d, ...
+            branch_to_next,     // b L; L: -> L:
+            count,
+        };
+
+        void run(std::vector<Instr>& code) {
+            m_instructions_before += code.size();
+            m_out.clear();
+            m_out.reserve(code.size());
+            m_in = &code;
+            for (m_next = 0; m_next < code.size();) {
+                m_out.push_back(code[m_next++]);
+                while (match()) {}
+            }
+            code.swap(m_out);
+            m_instructions_after += code.size();
+        }
+
+        size_t hits(Pattern pattern) const {
+            return m_hits[static_cast<size_t>(pattern)];
+        }
+
+        void report(std::ostream& out) const {
+            static constexpr std::string_view names[] = {
+                "store/load forwarding", "self move",
+                "immediate operand", "move coalescing", "branch to next",
+            };
+            out << "peephole: " << m_instructions_before << " -> " << m_instructions_after << " instructions\n";
+            for (size_t i = 0; i < m_hits.size(); i++) {
+                out << "  " << std::left << std::setw(24) << names[i] << m_hits[i] << "\n";
+            }
+        }
+
+    private:
+        const std::vector<Instr>* m_in = nullptr;
+        size_t m_next = 0;              // first input instruction not yet moved
+        std::vector<Instr> m_out;
+        std::array<size_t, static_cast<size_t>(Pattern::count)> m_hits{};
+        size_t m_instructions_before = 0;
+        size_t m_instructions_after = 0;
+
+        bool hit(Pattern pattern) {
+            m_hits[static_cast<size_t>(pattern)]++;
+            return true;
+        }
+
+        // Try each pattern on the end of the output; true if one fired
+        bool match() {
+            if (m_out.empty()) {
+                return false;
+            }
+            Instr& last = m_out.back();
+
+            if (last.op == Opcode::mov && !last.has_immediate() && last.rm == last.rd) {
+                m_out.pop_back();
+                return hit(Pattern::self_move);
+            }
+            if (last.op == Opcode::label && remove_branch_to(last)) {
+                return hit(Pattern::branch_to_next);
+            }
+            if (m_out.size() < 2) {
+                return false;
+            }
+            Instr& prev = m_out[m_out.size() - 2];
+
+            // A store followed by a load of the same cell: the value is
+            // still in the stored register
+            if (last.op == Opcode::ldr && prev.op == Opcode::str && prev.imm == last.imm) {
+                last = Instr::mov(last.rd, prev.rd);
+                return hit(Pattern::store_load);
+            }
+
+            if (prev.op == Opcode::mov && prev.has_immediate() && arith_immediate(prev.imm) &&
+                (last.op == Opcode::add || last.op == Opcode::sub) && !last.has_immediate() && last.imm == 0 &&
+                (last.rd == prev.rd || dead_after(prev.rd))) {
+                const uint8_t temp = prev.rd;
+                if (last.op == Opcode::add && last.rn == temp && last.rm != temp) {
+                    std::swap(last.rn, last.rm);
+                }
+                if (last.rm == temp && last.rn != temp) {
+                    last.rm = no_register;
+                    last.imm = prev.imm;
+                    m_out.erase(m_out.end() - 2);
+                    return hit(Pattern::immediate_operand);
+                }
+            }
+
+            if (last.op == Opcode::mov && !last.has_immediate() && defines_only(prev, last.rm) &&
+                dead_after(last.rm)) {
+                prev.rd = last.rd;
+                m_out.pop_back();
+                return hit(Pattern::move_coalesce);
+            }
+            return false;
+        }
+
+        // `instr` computes a fresh value into `reg` without reading it, so it
+        // can compute into another register instead
+        static bool defines_only(const Instr& instr, uint8_t reg) {
+            switch (instr.op) {
+                case Opcode::mov:
+                case Opcode::add:
+                case Opcode::sub:
+                case Opcode::mul:
+                case Opcode::udiv:
+                case Opcode::lsl:
+                case Opcode::lsr:
+                case Opcode::neg:
+                case Opcode::ldr:
+                    return instr.rd == reg;
+                default:
+                    return false;
+            }
+        }
+
+        // Delete a branch to `label` that reaches it by falling through
+        // anyway: only labels lie between them
+        bool remove_branch_to(const Instr& label) {
+            for (size_t i = m_out.size() - 1; i-- > 0;) {
+                const Instr& instr = m_out[i];
+                if (instr.is_branch()) {
+                    if (instr.imm != label.imm) {
+                        return false;
+                    }
+                    m_out.erase(m_out.begin() + static_cast<std::ptrdiff_t>(i));
+                    return true;
+                }
+                if (instr.op != Opcode::label) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        // Nothing still to come reads `reg` before overwriting it
+        bool dead_after(uint8_t reg) const {
+            const std::vector<Instr>& in = *m_in;
+            for (size_t i = m_next; i < in.size(); i++) {
+                const Instr& instr = in[i];
+                if (instr.reads(reg)) {
+                    return false;
+                }
+                if (instr.writes(reg) || instr.op == Opcode::exit) {
+                    return true;
+                }
+                if (instr.op == Opcode::label || instr.is_branch()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "instructions.hpp"
+#include "ir.hpp"
+
+inline constexpr uint32_t no_cell = UINT32_MAX;
+
+// Where each IR value lives: a register number (w<n>), or no_register and a
+// stack cell for values spilled to the stack. Spilled values whose
+// lifetimes do not overlap share a cell. Constants without a register are
+// loaded again where they are read, and values the generator never keeps
+// anywhere (undef, stores, constants used as immediates, comparisons
+// folded into a branch) have neither.
+struct RegisterAssignment {
+    std::vector<uint8_t> registers;   // indexed by ValueId
+    std::vector<uint32_t> cells;      // indexed by ValueId, no_cell if not spilled
+    uint32_t cell_count = 0;
+    size_t spilled = 0;
+
+    bool in_register(ValueId value) const {
+        return registers[value] != no_register;
+    }
+
+    bool in_cell(ValueId value) const {
+        return cells[value] != no_cell;
+    }
+};
+
+// Linear-scan register allocation (Poletto & Sarkar) for SSA values.
+//
+// Program points are numbered along `layout`, a reverse postorder of the
+// reachable blocks. The CFG has no cycles, so every edge goes forward in
+// that order and a value is live at most over [definition, last use]. An
+// instruction reads its operands at point 2n and defines its value at
+// 2n + 1, so `v2 = add v1, 1` can hand v1's register to v2 when v1 dies
+// there. Phis are defined on entry to their block and their arguments read
+// at the end of the predecessor they come from, where the generator puts
+// the moves.
+//
+// Intervals are visited by start point; a register becomes free once its
+// interval has ended, and when none is free a constant gives its register
+// up first, then the interval ending last is spilled. A phi takes the
+// register of one of its arguments if that is free, which saves the move
+// on that edge.
+class RegisterAllocator {
+    public:
+        // w9 and w10 are the generator's scratch registers for spilled
+        // operands, constants and phi move cycles, w0 carries the exit
+        // status, x16/x17 are the intra-procedure-call registers (x16 holds
+        // the syscall number) and x18 is reserved by the platform. _main
+        // leaves through the exit syscall and never returns, so the
+        // callee-saved x19-x28 need no saving.
+        static constexpr std::array<uint8_t, 23> pool = {
+            2, 3, 4, 5, 6, 7, 8, 1,
+            11, 12, 13, 14, 15,
+            19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+        };
+
+        // `folded` marks values the generator folds into the instructions
+        // that read them: comparisons it branches on, and constants it
+        // only uses as immediates. Their operands are read where they are.
+        inline RegisterAllocator(const IrProgram& program, const std::vector<BlockId>& layout,
+                                 const std::vector<bool>& folded, size_t register_count = pool.size())
+            : m_program(program), m_layout(layout), m_folded(folded),
+              m_register_count(std::min(register_count, pool.size())),
+              m_intervals(program.values.size()) {}
+
+        RegisterAssignment allocate() {
+            std::vector<ValueId> order = number();
+
+            RegisterAssignment result;
+            result.registers.assign(m_intervals.size(), no_register);
+            std::vector<uint8_t> free(pool.rbegin() + static_cast<std::ptrdiff_t>(pool.size() - m_register_count), pool.rend());
+            std::vector<ValueId> active;    // values holding a register, by increasing end
+            auto by_end = [this](ValueId a, ValueId b) {
+                return m_intervals[a].end < m_intervals[b].end;
+            };
+
+            for (ValueId value : order) {
+                const Interval& current = m_intervals[value];
+
+                // Expire intervals that ended before this one starts
+                size_t expired = 0;
+                while (expired < active.size() && m_intervals[active[expired]].end < current.start) {
+                    free.push_back(result.registers[active[expired]]);
+                    expired++;
+                }
+                active.erase(active.begin(), active.begin() + static_cast<std::ptrdiff_t>(expired));
+
+                if (!free.empty()) {
+                    auto chosen = free.end() - 1;
+                    const IrInst& inst = m_program.values[value];
+                    if (inst.op == IrOp::phi) {
+                        for (ValueId arg : m_program.args(inst)) {
+                            auto hinted = std::find(free.begin(), free.end(), result.registers[arg]);
+                            if (hinted != free.end()) {
+                                chosen = hinted;
+                                break;
+                            }
+                        }
+                    }
+                    result.registers[value] = *chosen;
+                    free.erase(chosen);
+                    active.insert(std::upper_bound(active.begin(), active.end(), value, by_end), value);
+                } else if (const auto victim = choose_victim(value, active); victim != active.end()) {
+                    result.registers[value] = result.registers[*victim];
+                    result.registers[*victim] = no_register;
+                    result.spilled++;
+                    active.erase(victim);
+                    active.insert(std::upper_bound(active.begin(), active.end(), value, by_end), value);
+                } else {
+                    result.spilled++;
+                }
+            }
+            assign_cells(order, result);
+            return result;
+        }
+
+    private:
+        static constexpr uint32_t unseen = UINT32_MAX;
+
+        bool is_constant(ValueId value) const {
+            return m_program.values[value].op == IrOp::constant;
+        }
+
+        // Whose register `value` takes when none is free: a constant's,
+        // as that costs a mov where it is read rather than a store and
+        // loads, or else the interval that lives longest, if it outlives
+        // `value`. Constants themselves never steal.
+        std::vector<ValueId>::iterator choose_victim(ValueId value, std::vector<ValueId>& active) const {
+            if (is_constant(value)) {
+                return active.end();
+            }
+            for (auto it = active.end(); it != active.begin();) {
+                if (is_constant(*--it)) {
+                    return it;
+                }
+            }
+            if (!active.empty() && m_intervals[active.back()].end > m_intervals[value].end) {
+                return active.end() - 1;
+            }
+            return active.end();
+        }
+
+        struct Interval {
+            uint32_t start = unseen;
+            uint32_t end = 0;
+        };
+
+        const IrProgram& m_program;
+        const std::vector<BlockId>& m_layout;
+        const std::vector<bool>& m_folded;
+        size_t m_register_count;
+        std::vector<Interval> m_intervals;  // indexed by ValueId
+
+        // Values that are kept in a register or a cell
+        bool allocated(ValueId value) const {
+            switch (m_program.values[value].op) {
+                case IrOp::nop:
+                case IrOp::undef:
+                case IrOp::store:
+                    return false;
+                default:
+                    return !m_folded[value];
+            }
+        }
+
+        void use(ValueId value, uint32_t point) {
+            if (allocated(value)) {
+                m_intervals[value].end = std::max(m_intervals[value].end, point);
+            }
+        }
+
+        void define(ValueId value, uint32_t point, std::vector<ValueId>& order) {
+            if (allocated(value)) {
+                m_intervals[value] = Interval{point, point};
+                order.push_back(value);
+            }
+        }
+
+        // Fill in the intervals; returns the allocated values by start point
+        std::vector<ValueId> number() {
+            std::vector<ValueId> order;
+            uint32_t position = 0;
+            for (BlockId block_id : m_layout) {
+                const IrBlock& block = m_program.blocks[block_id];
+                position++;
+                for (ValueId id : block.insts) {
+                    const IrInst& inst = m_program.values[id];
+                    if (inst.op == IrOp::phi) {
+                        define(id, 2 * position + 1, order);
+                        continue;
+                    }
+                    position++;
+                    m_program.for_each_operand(inst, [&](ValueId operand) {
+                        use(operand, 2 * position);
+                    });
+                    define(id, 2 * position + 1, order);
+                }
+
+                position++;
+                if (block.value != no_value) {
+                    use(block.value, 2 * position);
+                }
+                for (BlockId succ : block.successors()) {
+                    const IrBlock& target = m_program.blocks[succ];
+                    for (size_t i = 0; i < target.preds.size(); i++) {
+                        if (target.preds[i] != block_id) {
+                            continue;
+                        }
+                        for (ValueId id : target.insts) {
+                            const IrInst& phi = m_program.values[id];
+                            if (phi.op != IrOp::phi) {
+                                break;
+                            }
+                            use(m_program.args(phi)[i], 2 * position);
+                        }
+                    }
+                }
+            }
+            return order;
+        }
+
+        // Spilled values get stack cells by the same scan, except that there
+        // is always another cell: a cell is free again once the interval
+        // holding it has ended, so the frame needs only as many cells as
+        // there are spilled values live at once.
+        void assign_cells(const std::vector<ValueId>& order, RegisterAssignment& result) const {
+            result.cells.assign(m_intervals.size(), no_cell);
+            using Active = std::pair<uint32_t, uint32_t>;   // end, cell
+            std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+            std::vector<uint32_t> free;
+
+            for (ValueId value : order) {
+                if (result.in_register(value) || is_constant(value)) {
+                    continue;
+                }
+                const Interval& current = m_intervals[value];
+                while (!active.empty() && active.top().first < current.start) {
+                    free.push_back(active.top().second);
+                    active.pop();
+                }
+                uint32_t cell;
+                if (!free.empty()) {
+                    cell = free.back();
+                    free.pop_back();
+                } else {
+                    cell = result.cell_count++;
+                }
+                result.cells[value] = cell;
+                active.emplace(current.end, cell);
+            }
+        }
+};
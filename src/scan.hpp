@@ -0,0 +1,204 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized byte scanning for the tokenizer's hot runs: whitespace, digit
+// runs and comment bodies. Each routine handles 32 (AVX2) or 16 (SSE2/NEON)
+// bytes per step and finishes the tail with a scalar loop; defining
+// HYDRO_NO_SIMD (or building for another target) keeps only the scalar loop.
+
+#if !defined(HYDRO_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define HYDRO_SCAN_AVX2 1
+#elif !defined(HYDRO_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define HYDRO_SCAN_SSE2 1
+#elif !defined(HYDRO_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HYDRO_SCAN_NEON 1
+#endif
+
+#if defined(HYDRO_SCAN_AVX2)
+
+using ScanVec = __m256i;
+inline constexpr size_t scan_width = 32;
+inline constexpr unsigned scan_bits_per_byte = 1;
+
+inline ScanVec scan_load(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+inline ScanVec scan_eq(ScanVec v, char c) {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+// Unsigned lo <= v <= hi, per byte
+inline ScanVec scan_in_range(ScanVec v, char lo, char hi) {
+    __m256i off = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(off, _mm256_set1_epi8(static_cast<char>(hi - lo))), off);
+}
+
+inline ScanVec scan_or(ScanVec a, ScanVec b) {
+    return _mm256_or_si256(a, b);
+}
+
+inline uint64_t scan_bits(ScanVec mask) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+}
+
+#elif defined(HYDRO_SCAN_SSE2)
+
+using ScanVec = __m128i;
+inline constexpr size_t scan_width = 16;
+inline constexpr unsigned scan_bits_per_byte = 1;
+
+inline ScanVec scan_load(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline ScanVec scan_eq(ScanVec v, char c) {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+// Unsigned lo <= v <= hi, per byte
+inline ScanVec scan_in_range(ScanVec v, char lo, char hi) {
+    __m128i off = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(off, _mm_set1_epi8(static_cast<char>(hi - lo))), off);
+}
+
+inline ScanVec scan_or(ScanVec a, ScanVec b) {
+    return _mm_or_si128(a, b);
+}
+
+inline uint64_t scan_bits(ScanVec mask) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(mask));
+}
+
+#elif defined(HYDRO_SCAN_NEON)
+
+using ScanVec = uint8x16_t;
+inline constexpr size_t scan_width = 16;
+// NEON has no movemask; narrowing the compare result gives 4 bits per byte
+inline constexpr unsigned scan_bits_per_byte = 4;
+
+inline ScanVec scan_load(const char* p) {
+    return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+
+inline ScanVec scan_eq(ScanVec v, char c) {
+    return vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(c)));
+}
+
+// Unsigned lo <= v <= hi, per byte
+inline ScanVec scan_in_range(ScanVec v, char lo, char hi) {
+    uint8x16_t off = vsubq_u8(v, vdupq_n_u8(static_cast<uint8_t>(lo)));
+    return vcleq_u8(off, vdupq_n_u8(static_cast<uint8_t>(hi - lo)));
+}
+
+inline ScanVec scan_or(ScanVec a, ScanVec b) {
+    return vorrq_u8(a, b);
+}
+
+inline uint64_t scan_bits(ScanVec mask) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(mask), 4)), 0);
+}
+
+#endif
+
+#if defined(HYDRO_SCAN_AVX2) || defined(HYDRO_SCAN_SSE2) || defined(HYDRO_SCAN_NEON)
+#define HYDRO_SCAN_SIMD 1
+
+inline constexpr uint64_t scan_all_bits = scan_width * scan_bits_per_byte == 64
+    ? ~uint64_t{0}
+    : (uint64_t{1} << (scan_width * scan_bits_per_byte)) - 1;
+
+inline ScanVec scan_whitespace_mask(ScanVec v) {
+    // ' ' plus '\t' '\n' '\v' '\f' '\r'
+    return scan_or(scan_eq(v, ' '), scan_in_range(v, '\t', '\r'));
+}
+#endif
+
+constexpr bool scan_is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+constexpr bool scan_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// First byte in [p, end) that is not whitespace (newlines included)
+inline const char* scan_skip_whitespace(const char* p, const char* end) {
+#if defined(HYDRO_SCAN_SIMD)
+    while (static_cast<size_t>(end - p) >= scan_width) {
+        uint64_t stop = ~scan_bits(scan_whitespace_mask(scan_load(p))) & scan_all_bits;
+        if (stop) {
+            return p + std::countr_zero(stop) / scan_bits_per_byte;
+        }
+        p += scan_width;
+    }
+#endif
+    while (p < end && scan_is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// First byte in [p, end) that is not a decimal digit
+inline const char* scan_skip_digits(const char* p, const char* end) {
+#if defined(HYDRO_SCAN_SIMD)
+    while (static_cast<size_t>(end - p) >= scan_width) {
+        uint64_t stop = ~scan_bits(scan_in_range(scan_load(p), '0', '9')) & scan_all_bits;
+        if (stop) {
+            return p + std::countr_zero(stop) / scan_bits_per_byte;
+        }
+        p += scan_width;
+    }
+#endif
+    while (p < end && scan_is_digit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// First occurrence of `c` in [p, end), or end. Used to jump to the newline
+// ending a line comment and to the next '*' inside a block comment.
+inline const char* scan_find(const char* p, const char* end, char c) {
+#if defined(HYDRO_SCAN_SIMD)
+    while (static_cast<size_t>(end - p) >= scan_width) {
+        uint64_t hit = scan_bits(scan_eq(scan_load(p), c));
+        if (hit) {
+            return p + std::countr_zero(hit) / scan_bits_per_byte;
+        }
+        p += scan_width;
+    }
+#endif
+    while (p < end && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+// Calls on_newline(position) for every '\n' in [p, end), in order. The
+// vector path only visits the set bits of each block's compare mask.
+template <typename OnNewline>
+inline void scan_newlines(const char* p, const char* end, OnNewline&& on_newline) {
+#if defined(HYDRO_SCAN_SIMD)
+    while (static_cast<size_t>(end - p) >= scan_width) {
+        uint64_t hit = scan_bits(scan_eq(scan_load(p), '\n'));
+        while (hit) {
+            const unsigned bit = static_cast<unsigned>(std::countr_zero(hit));
+            on_newline(p + bit / scan_bits_per_byte);
+            // Clear every bit belonging to that byte
+            hit &= ~(((uint64_t{1} << scan_bits_per_byte) - 1) << (bit - bit % scan_bits_per_byte));
+        }
+        p += scan_width;
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            on_newline(p);
+        }
+    }
+}
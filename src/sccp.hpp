@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "dominators.hpp"
+#include "ir.hpp"
+
+// Sparse conditional constant propagation (Wegman & Zadeck, "Constant
+// Propagation with Conditional Branches") on the IR.
+//
+// Every value starts out unknown, meaning no executed path has defined it
+// yet, and can only move down: to one constant, and then to overdefined,
+// not a constant. A block is executed if an executed edge leads into it:
+// the entry, a jump from an executed block, or a side of a branch its
+// condition can take, which is both unless the condition is a constant. A
+// phi meets only the arguments coming over executed edges, so a variable
+// set to 3 in an arm that a constant condition always takes is still 3
+// after the if, and so is everything computed from it.
+//
+// The CFG has no cycles, so a single pass in reverse postorder sees every
+// edge into a block before the block, and no worklist is needed.
+//
+// Values found constant are rewritten in place into constants, branch
+// conditions among them. DeadCodeEliminator then turns those branches into
+// jumps and deletes the arms never taken, with everything left unused.
+class ConstantPropagator {
+    public:
+        // Only `tree`'s block order is used
+        inline ConstantPropagator(IrProgram& program, const DominatorTree& tree)
+            : m_program(program), m_tree(tree) {}
+
+        // Returns the number of values rewritten into constants
+        size_t run() {
+            m_lattice.assign(m_program.values.size(), Lattice{});
+            m_executed.assign(m_program.blocks.size(), false);
+            const std::vector<BlockId>& order = m_tree.order();
+            m_executed[m_program.entry] = true;
+            for (BlockId block : order) {
+                if (!m_executed[block]) {
+                    continue;
+                }
+                for (ValueId id : m_program.blocks[block].insts) {
+                    m_lattice[id] = evaluate(block, m_program.values[id]);
+                }
+                for (BlockId succ : taken_successors(block)) {
+                    m_executed[succ] = true;
+                }
+            }
+            size_t rewritten = 0;
+            for (BlockId block : order) {
+                if (m_executed[block]) {
+                    rewritten += rewrite(block);
+                }
+            }
+            return rewritten;
+        }
+
+    private:
+        struct Lattice {
+            enum class State : uint8_t {
+                unknown,
+                constant,
+                overdefined,
+            };
+            State state = State::unknown;
+            uint32_t value = 0;
+
+            static Lattice constant(uint32_t value) {
+                return Lattice{State::constant, value};
+            }
+
+            static Lattice overdefined() {
+                return Lattice{State::overdefined, 0};
+            }
+
+            bool is_constant(uint32_t c) const {
+                return state == State::constant && value == c;
+            }
+        };
+
+        IrProgram& m_program;
+        const DominatorTree& m_tree;
+        std::vector<Lattice> m_lattice;     // by value
+        std::vector<bool> m_executed;       // by block
+
+        // The successors of an executed block that control can reach
+        std::span<const BlockId> taken_successors(BlockId block_id) const {
+            const IrBlock& block = m_program.blocks[block_id];
+            if (block.term == IrTerm::branch) {
+                const Lattice& condition = m_lattice[block.value];
+                if (condition.state == Lattice::State::constant) {
+                    return {&block.succs[condition.value != 0 ? 0 : 1], 1};
+                }
+            }
+            return block.successors();
+        }
+
+        bool edge_taken(BlockId from, BlockId to) const {
+            if (!m_executed[from]) {
+                return false;
+            }
+            const std::span<const BlockId> succs = taken_successors(from);
+            return std::find(succs.begin(), succs.end(), to) != succs.end();
+        }
+
+        Lattice evaluate(BlockId block, const IrInst& inst) const {
+            switch (inst.op) {
+                case IrOp::constant:
+                    return Lattice::constant(inst.imm);
+                case IrOp::undef:
+                case IrOp::nop:
+                case IrOp::store:
+                    return Lattice{};
+                case IrOp::load:
+                    return Lattice::overdefined();
+                case IrOp::phi:
+                    return meet_phi(block, inst);
+                default:
+                    return evaluate_binary(inst);
+            }
+        }
+
+        Lattice meet_phi(BlockId block, const IrInst& phi) const {
+            const std::vector<BlockId>& preds = m_program.blocks[block].preds;
+            const std::span<const ValueId> args = m_program.args(phi);
+            Lattice result;
+            for (size_t i = 0; i < preds.size(); i++) {
+                if (!edge_taken(preds[i], block)) {
+                    continue;
+                }
+                const Lattice& arg = m_lattice[args[i]];
+                if (arg.state == Lattice::State::unknown) {
+                    continue;
+                }
+                if (arg.state == Lattice::State::overdefined ||
+                    (result.state == Lattice::State::constant && result.value != arg.value)) {
+                    return Lattice::overdefined();
+                }
+                result = arg;
+            }
+            return result;
+        }
+
+        // Both operands constant, or one that decides the result alone: the
+        // same identities ConstantFolder applies to the AST. A divisor found
+        // to be 0 is not folded, as ConstantFolder does not fold a literal
+        // one either (it reports it); the udiv stays, and yields 0 at
+        // runtime as it does at every optimization level.
+        Lattice evaluate_binary(const IrInst& inst) const {
+            const Lattice& lhs = m_lattice[inst.a];
+            const Lattice& rhs = m_lattice[inst.b];
+            if (inst.op == IrOp::div && rhs.is_constant(0)) {
+                return Lattice::overdefined();
+            }
+            if (lhs.state == Lattice::State::constant && rhs.state == Lattice::State::constant) {
+                return Lattice::constant(fold(inst.op, lhs.value, rhs.value));
+            }
+            const bool same = inst.a == inst.b;
+            switch (inst.op) {
+                case IrOp::mul:
+                    if (lhs.is_constant(0) || rhs.is_constant(0)) {
+                        return Lattice::constant(0);
+                    }
+                    break;
+                case IrOp::div:
+                    // udiv by zero yields 0, so 0 / x is 0 for every x
+                    if (lhs.is_constant(0)) {
+                        return Lattice::constant(0);
+                    }
+                    break;
+                case IrOp::sub:
+                case IrOp::ne:
+                    if (same) {
+                        return Lattice::constant(0);
+                    }
+                    break;
+                case IrOp::eq:
+                    if (same) {
+                        return Lattice::constant(1);
+                    }
+                    break;
+                // Unsigned: nothing is below 0
+                case IrOp::lt:
+                case IrOp::gt:
+                    if (same || (inst.op == IrOp::lt ? rhs : lhs).is_constant(0)) {
+                        return Lattice::constant(0);
+                    }
+                    break;
+                case IrOp::le:
+                case IrOp::ge:
+                    if (same || (inst.op == IrOp::le ? lhs : rhs).is_constant(0)) {
+                        return Lattice::constant(1);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            if (lhs.state == Lattice::State::overdefined || rhs.state == Lattice::State::overdefined) {
+                return Lattice::overdefined();
+            }
+            return Lattice{};
+        }
+
+        static uint32_t fold(IrOp op, uint32_t lhs, uint32_t rhs) {
+            switch (op) {
+                case IrOp::add:
+                    return lhs + rhs;
+                case IrOp::sub:
+                    return lhs - rhs;
+                case IrOp::mul:
+                    return lhs * rhs;
+                case IrOp::div:
+                    return rhs == 0 ? 0 : lhs / rhs;
+                case IrOp::eq:
+                    return lhs == rhs;
+                case IrOp::ne:
+                    return lhs != rhs;
+                case IrOp::lt:
+                    return lhs < rhs;
+                case IrOp::le:
+                    return lhs <= rhs;
+                case IrOp::gt:
+                    return lhs > rhs;
+                case IrOp::ge:
+                    return lhs >= rhs;
+                default:
+                    return 0;
+            }
+        }
+
+        // Turn the block's constant values into constants, keeping its
+        // remaining phis first; returns how many there were
+        size_t rewrite(BlockId block_id) {
+            std::vector<ValueId>& insts = m_program.blocks[block_id].insts;
+            size_t rewritten = 0;
+            bool rewrote_phi = false;
+            for (ValueId id : insts) {
+                IrInst& inst = m_program.values[id];
+                if (inst.op == IrOp::constant || m_lattice[id].state != Lattice::State::constant) {
+                    continue;
+                }
+                rewrote_phi = rewrote_phi || inst.op == IrOp::phi;
+                inst = IrInst{IrOp::constant, block_id, no_value, no_value, m_lattice[id].value};
+                rewritten++;
+            }
+            if (rewrote_phi) {
+                std::stable_partition(insts.begin(), insts.end(), [&](ValueId id) {
+                    return m_program.values[id].op == IrOp::phi;
+                });
+            }
+            return rewritten;
+        }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+// Latencies, in cycles, of the instructions strength reduction trades
+// against each other. Only their relative sizes matter.
+struct CostModel {
+    std::string_view name;
+    uint8_t alu;            // add, sub, neg, shift by immediate
+    uint8_t alu_shifted;    // add/sub with a shifted register operand
+    uint8_t mul;
+    uint8_t umull;
+    uint8_t udiv;           // 32-bit, typical operands
+};
+
+inline constexpr CostModel apple_m1{"apple-m1", 1, 2, 3, 3, 7};
+inline constexpr CostModel cortex_a72{"cortex-a72", 1, 2, 3, 3, 12};
+inline constexpr std::array<const CostModel*, 2> cost_models = {&apple_m1, &cortex_a72};
+
+// Instruction counts instead of latencies, for -Os. mul and udiv count the
+// mov loading the constant, and umull the mov/movk pair loading the magic
+// number, so only reductions that are no longer than that are used.
+inline constexpr CostModel code_size{"size", 1, 1, 2, 3, 2};
+
+inline const CostModel* find_cost_model(std::string_view name) {
+    for (const CostModel* model : cost_models) {
+        if (model->name == name) {
+            return model;
+        }
+    }
+    return nullptr;
+}
+
+// How to multiply or divide by a constant without mul/udiv, if that is
+// cheaper on the target.
+//
+// `steps` form a chain: the first step reads the operand, each later one
+// the previous result. A division by a constant that is not a power of two
+// multiplies by a magic number instead (Granlund & Montgomery, "Division by
+// Invariant Integers using Multiplication"):
+//
+//     magic:      q = (n * m) >> (32 + shift)
+//     magic_add:  t = (n * m) >> 32;  q = (t + ((n - t) >> 1)) >> shift
+//
+// the second being for divisors whose exact magic number needs 33 bits.
+struct Reduction {
+    enum class Kind : uint8_t {
+        none,       // keep mul/udiv
+        steps,
+        magic,
+        magic_add,
+    };
+
+    enum class Step : uint8_t {
+        lsl,        // r << k
+        lsr,        // r >> k
+        add_lsl,    // r + (r << k)
+        sub_lsl,    // r - (r << k)
+        neg,        // -r
+    };
+
+    Kind kind = Kind::none;
+    uint8_t count = 0;
+    std::array<Step, 3> steps{};
+    std::array<uint8_t, 3> shifts{};
+    uint32_t magic = 0;
+    uint8_t shift = 0;
+    unsigned cost = 0;
+
+    bool needs_temp() const {
+        return kind == Kind::magic || kind == Kind::magic_add;
+    }
+
+    void add(Step step, uint8_t amount, unsigned step_cost) {
+        steps[count] = step;
+        shifts[count] = amount;
+        count++;
+        cost += step_cost;
+    }
+};
+
+// x * c as shifts and adds. The constant is split as odd * 2^b and the odd
+// part tried as 1, 2^a + 1, 2^a - 1 and (2^a + 1)(2^e + 1); the cheapest
+// chain is kept if it beats a mul. All arithmetic wraps at 32 bits, as mul
+// does.
+inline Reduction plan_multiply(uint32_t c, const CostModel& costs) {
+    Reduction best;
+    if (c == 0) {
+        return best;
+    }
+    best.cost = costs.mul;
+    const uint8_t low_zeros = static_cast<uint8_t>(std::countr_zero(c));
+    const uint32_t odd = c >> low_zeros;
+
+    auto consider = [&](Reduction candidate) {
+        candidate.kind = Reduction::Kind::steps;
+        if (low_zeros != 0) {
+            candidate.add(Reduction::Step::lsl, low_zeros, costs.alu);
+        }
+        // Ties go to the reduction: it also saves loading the constant
+        if (candidate.count != 0 && candidate.cost <= best.cost) {
+            best = candidate;
+        }
+    };
+
+    if (odd == 1) {
+        consider(Reduction{});
+    }
+    for (uint8_t a = 1; a < 32; a++) {
+        const uint32_t factor = (1u << a) + 1;
+        if (odd == factor) {
+            Reduction r;
+            r.add(Reduction::Step::add_lsl, a, costs.alu_shifted);
+            consider(r);
+        }
+        if (a >= 2 && odd == (1u << a) - 1) {
+            // x - (x << a) is -(2^a - 1)x
+            Reduction r;
+            r.add(Reduction::Step::sub_lsl, a, costs.alu_shifted);
+            r.add(Reduction::Step::neg, 0, costs.alu);
+            consider(r);
+        }
+        if (odd % factor == 0) {
+            const uint32_t rest = odd / factor - 1;
+            if (std::has_single_bit(rest) && rest > 1) {
+                Reduction r;
+                r.add(Reduction::Step::add_lsl, a, costs.alu_shifted);
+                r.add(Reduction::Step::add_lsl, static_cast<uint8_t>(std::countr_zero(rest)), costs.alu_shifted);
+                consider(r);
+            }
+        }
+    }
+    return best;
+}
+
+// n / d for a constant d != 0: a shift for powers of two, otherwise a
+// multiply by the magic number, if either beats a udiv
+inline Reduction plan_divide(uint32_t d, const CostModel& costs) {
+    Reduction plan;
+    if (d == 0) {
+        return plan;
+    }
+    if (std::has_single_bit(d)) {
+        plan.kind = Reduction::Kind::steps;
+        plan.add(Reduction::Step::lsr, static_cast<uint8_t>(std::countr_zero(d)), costs.alu);
+    } else {
+        // ceil(log2(d))
+        const uint32_t l = 32 - static_cast<uint32_t>(std::countl_zero(d - 1));
+        // The smallest shift with a 32-bit m = ceil(2^(32+s) / d) whose
+        // error m * d - 2^(32+s) is at most 2^s, which makes the quotient
+        // exact for every 32-bit n
+        for (uint32_t s = 0; s <= l && s < 32; s++) {
+            const uint64_t scale = uint64_t{1} << (32 + s);
+            const uint64_t m = (scale + d - 1) / d;
+            if (m >> 32 == 0 && m * d - scale <= (uint64_t{1} << s)) {
+                plan.kind = Reduction::Kind::magic;
+                plan.magic = static_cast<uint32_t>(m);
+                plan.shift = static_cast<uint8_t>(s);
+                plan.cost = costs.umull + costs.alu;
+                break;
+            }
+        }
+        if (plan.kind == Reduction::Kind::none) {
+            // m = 2^32 * (2^l - d) / d + 1, the low 32 bits of the 33-bit
+            // magic number
+            plan.kind = Reduction::Kind::magic_add;
+            plan.magic = static_cast<uint32_t>(((uint64_t{1} << 32) * ((uint64_t{1} << l) - d)) / d + 1);
+            plan.shift = static_cast<uint8_t>(l - 1);
+            plan.cost = costs.umull + 3 * costs.alu + costs.alu_shifted;
+        }
+    }
+    if (plan.cost >= costs.udiv) {
+        return Reduction{};
+    }
+    return plan;
+}
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
-enum class TokenType {
+#include "interner.hpp"
+#include "scan.hpp"
+
+enum class TokenType : uint8_t {
     _exit,
     int_lit,
     semi,
@@ -16,6 +25,12 @@ enum class TokenType {
     star,
     slash,
     minus,
+    eq_eq,
+    not_eq_,
+    less,
+    less_eq,
+    greater,
+    greater_eq,
     open_brace,
     close_brace,
     if_,
@@ -23,139 +38,441 @@ enum class TokenType {
     elif,
 };
 
+// Tokens do not own their text: `value` views the source buffer handed to the
+// Tokenizer, so that buffer must outlive every Token (and every AST node built
+// from one). Where the view starts is also the token's source position; line
+// and column are only worked out from it when a diagnostic is printed.
+// Identifiers also carry their interned symbol.
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
+    SymbolId symbol = no_symbol;   // ident only
+};
+
+struct SourceLocation {
     size_t line;
     size_t column;
 };
 
-class Tokenizer {
+// Offset of the first character of every line, filled in by the tokenizer as
+// it passes newlines.
+class LineTable {
     public:
-        inline Tokenizer(const std::string& src) : m_src(std::move(src)) {}
-
-
-        inline std::vector<Token> tokenize() {
-            std::string buf;
-            std::vector<Token> tokens;
-            size_t line = 1;
-            size_t column = 1;
-
-            while(peek().has_value()) {
-                char c = consume();
-                if (isspace(c)) {
-                    if (c == '\n') {
-                        line++;
-                        column = 1;
-                    } else {
-                        column++;
-                    }
+        LineTable() : m_starts{0} {}
+
+        void add_line(uint32_t start) {
+            m_starts.push_back(start);
+        }
+
+        SourceLocation locate(uint32_t offset) const {
+            auto it = std::upper_bound(m_starts.begin(), m_starts.end(), offset);
+            size_t line = static_cast<size_t>(it - m_starts.begin());
+            return SourceLocation{line, offset - *(it - 1) + 1};
+        }
+
+    private:
+        std::vector<uint32_t> m_starts;
+};
+
+// Every token with a fixed spelling. The character class table, the
+// punctuation table and the keyword hash below are all generated from this
+// list at compile time, so a new keyword or operator only needs an entry here.
+struct TokenSpec {
+    std::string_view text;
+    TokenType type;
+};
+
+inline constexpr TokenSpec token_spec[] = {
+    {"exit", TokenType::_exit},
+    {"let", TokenType::let},
+    {"if", TokenType::if_},
+    {"elif", TokenType::elif},
+    {"else", TokenType::else_},
+    {";", TokenType::semi},
+    {"(", TokenType::open_paren},
+    {")", TokenType::close_paren},
+    {"=", TokenType::eq},
+    {"+", TokenType::plus},
+    {"*", TokenType::star},
+    {"/", TokenType::slash},
+    {"-", TokenType::minus},
+    {"==", TokenType::eq_eq},
+    {"!=", TokenType::not_eq_},
+    {"<", TokenType::less},
+    {"<=", TokenType::less_eq},
+    {">", TokenType::greater},
+    {">=", TokenType::greater_eq},
+    {"{", TokenType::open_brace},
+    {"}", TokenType::close_brace},
+};
+
+enum class CharClass : uint8_t {
+    other,
+    space,
+    newline,
+    alpha,
+    digit,
+    punct,
+    slash, // also punctuation, but starts comments
+    star,  // also punctuation, but ends block comments
+    relation, // '<', '>' and '!', which may be followed by '='
+    equals,   // '=', on its own or as the second half of the above
+    count,
+};
+
+constexpr bool is_alpha_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr std::array<CharClass, 256> make_char_classes() {
+    std::array<CharClass, 256> classes{};
+    for (int c = 0; c < 256; c++) {
+        if (is_alpha_char(static_cast<char>(c))) {
+            classes[c] = CharClass::alpha;
+        } else if (c >= '0' && c <= '9') {
+            classes[c] = CharClass::digit;
+        }
+    }
+    for (char c : {' ', '\t', '\r', '\v', '\f'}) {
+        classes[static_cast<uint8_t>(c)] = CharClass::space;
+    }
+    classes['\n'] = CharClass::newline;
+    for (const auto& spec : token_spec) {
+        if (spec.text.size() == 1 && !is_alpha_char(spec.text[0])) {
+            classes[static_cast<uint8_t>(spec.text[0])] = CharClass::punct;
+        }
+    }
+    classes['/'] = CharClass::slash;
+    classes['*'] = CharClass::star;
+    classes['<'] = CharClass::relation;
+    classes['>'] = CharClass::relation;
+    classes['!'] = CharClass::relation;
+    classes['='] = CharClass::equals;
+    return classes;
+}
+
+constexpr std::array<TokenType, 256> make_punct_types() {
+    std::array<TokenType, 256> types{};
+    for (const auto& spec : token_spec) {
+        if (spec.text.size() == 1 && !is_alpha_char(spec.text[0])) {
+            types[static_cast<uint8_t>(spec.text[0])] = spec.type;
+        }
+    }
+    return types;
+}
+
+inline constexpr std::array<CharClass, 256> char_classes = make_char_classes();
+inline constexpr std::array<TokenType, 256> punct_types = make_punct_types();
+
+// Perfect hash over the keywords in token_spec. The multipliers are searched
+// at compile time until every keyword lands in its own slot, so a keyword
+// lookup is one hash plus at most one string compare no matter how many
+// keywords exist.
+struct KeywordTable {
+    static constexpr size_t size = 16;
+    uint32_t first_mul = 0;
+    uint32_t len_mul = 0;
+    std::array<TokenSpec, size> slots{};
+    std::array<bool, size> used{};
+
+    constexpr size_t slot(std::string_view word) const {
+        uint32_t h = static_cast<uint8_t>(word.front()) * first_mul
+            + static_cast<uint8_t>(word.back())
+            + static_cast<uint32_t>(word.size()) * len_mul;
+        return h % size;
+    }
+};
+
+constexpr KeywordTable make_keyword_table() {
+    for (uint32_t first_mul = 1; first_mul < 64; first_mul++) {
+        for (uint32_t len_mul = 0; len_mul < 64; len_mul++) {
+            KeywordTable table;
+            table.first_mul = first_mul;
+            table.len_mul = len_mul;
+            bool collision = false;
+            for (const auto& spec : token_spec) {
+                if (!is_alpha_char(spec.text[0])) {
                     continue;
                 }
-                if (isalpha(c)) {
-                    buf += c;
-                    while (peek().has_value() && isalpha(peek().value())) {
-                        buf += consume();
-                    }
-                    if (buf == "exit") {
-                        tokens.push_back(Token{TokenType::_exit, buf, line, column});
-                        buf.clear();
-                    } else if (buf == "let") {
-                        tokens.push_back(Token{TokenType::let, buf, line, column});
-                        buf.clear();
-                    } else if (buf == "if") {
-                        tokens.push_back(Token{TokenType::if_, buf, line, column});
-                        buf.clear();
-                    } else if (buf == "elif") {
-                        tokens.push_back(Token{TokenType::elif, buf, line, column});
-                        buf.clear();
-                    } else if (buf == "else") {
-                        tokens.push_back(Token{TokenType::else_, buf, line, column});
-                        buf.clear();
-                    } else {
-                        tokens.push_back(Token{TokenType::ident, buf, line, column});
-                        buf.clear();
-                    }
-                } else if (isdigit(c)) {
-                    buf += c;
-                    while (peek().has_value() && isdigit(peek().value())) {
-                        buf += consume();
+                size_t slot = table.slot(spec.text);
+                if (table.used[slot]) {
+                    collision = true;
+                    break;
+                }
+                table.used[slot] = true;
+                table.slots[slot] = spec;
+            }
+            if (!collision) {
+                return table;
+            }
+        }
+    }
+    throw "no perfect hash for the keyword set; grow KeywordTable::size";
+}
+
+inline constexpr KeywordTable keyword_table = make_keyword_table();
+
+// Lexer states. Each lexeme starts in `start` and follows the transition table
+// until it reaches `done`; the state it stopped in decides what was lexed.
+enum class LexState : uint8_t {
+    start,
+    space,
+    ident,
+    number,
+    punct,
+    relation,       // '<', '>', '!' or '='
+    relation_eq,    // one of those followed by '='
+    slash,
+    line_comment,
+    block_comment,
+    block_star,
+    block_end,
+    error,
+    done,
+    count,
+};
+
+using TransitionTable = std::array<std::array<LexState, static_cast<size_t>(CharClass::count)>,
+                                   static_cast<size_t>(LexState::count)>;
+
+constexpr TransitionTable make_transitions() {
+    TransitionTable table{};
+    for (auto& row : table) {
+        row.fill(LexState::done);
+    }
+    auto set = [&table](LexState from, CharClass cls, LexState to) {
+        table[static_cast<size_t>(from)][static_cast<size_t>(cls)] = to;
+    };
+    auto set_all = [&table](LexState from, LexState to) {
+        table[static_cast<size_t>(from)].fill(to);
+    };
+
+    set(LexState::start, CharClass::other, LexState::error);
+    set(LexState::start, CharClass::space, LexState::space);
+    set(LexState::start, CharClass::newline, LexState::space);
+    set(LexState::start, CharClass::alpha, LexState::ident);
+    set(LexState::start, CharClass::digit, LexState::number);
+    set(LexState::start, CharClass::punct, LexState::punct);
+    set(LexState::start, CharClass::star, LexState::punct);
+    set(LexState::start, CharClass::slash, LexState::slash);
+    set(LexState::start, CharClass::relation, LexState::relation);
+    set(LexState::start, CharClass::equals, LexState::relation);
+    set(LexState::relation, CharClass::equals, LexState::relation_eq);
+
+    set(LexState::space, CharClass::space, LexState::space);
+    set(LexState::space, CharClass::newline, LexState::space);
+    set(LexState::ident, CharClass::alpha, LexState::ident);
+    set(LexState::number, CharClass::digit, LexState::number);
+
+    set(LexState::slash, CharClass::slash, LexState::line_comment);
+    set(LexState::slash, CharClass::star, LexState::block_comment);
+
+    set_all(LexState::line_comment, LexState::line_comment);
+    set(LexState::line_comment, CharClass::newline, LexState::done);
+
+    set_all(LexState::block_comment, LexState::block_comment);
+    set(LexState::block_comment, CharClass::star, LexState::block_star);
+    set_all(LexState::block_star, LexState::block_comment);
+    set(LexState::block_star, CharClass::star, LexState::block_star);
+    set(LexState::block_star, CharClass::slash, LexState::block_end);
+    return table;
+}
+
+inline constexpr TransitionTable lex_transitions = make_transitions();
+
+// For each state, the set of character classes that loop back to that same
+// state. Runs of those characters (identifier bodies, digits, whitespace,
+// comment text) are skipped with a loop-invariant mask test instead of a
+// dependent table walk per character.
+constexpr std::array<uint32_t, static_cast<size_t>(LexState::count)> make_self_loops() {
+    std::array<uint32_t, static_cast<size_t>(LexState::count)> masks{};
+    for (size_t state = 0; state < masks.size(); state++) {
+        for (size_t cls = 0; cls < static_cast<size_t>(CharClass::count); cls++) {
+            if (lex_transitions[state][cls] == static_cast<LexState>(state)) {
+                masks[state] |= 1u << cls;
+            }
+        }
+    }
+    return masks;
+}
+
+inline constexpr std::array<uint32_t, static_cast<size_t>(LexState::count)> lex_self_loops = make_self_loops();
+
+// The type of a two-character operator such as "<="
+constexpr TokenType two_char_type(std::string_view text) {
+    for (const auto& spec : token_spec) {
+        if (spec.text == text) {
+            return spec.type;
+        }
+    }
+    return TokenType::eq;
+}
+
+class Tokenizer {
+    public:
+        inline explicit Tokenizer(std::string_view src) : m_src(src) {
+            if (src.size() > UINT32_MAX) {
+                throw std::length_error("Source files are limited to 4 GiB");
+            }
+        }
+
+        // Lex the next token, skipping whitespace and comments. Returns
+        // std::nullopt once the source is exhausted.
+        inline std::optional<Token> next() {
+            const size_t length = m_src.size();
+
+            while (m_pos < length) {
+                const size_t start = m_pos;
+                LexState state = LexState::start;
+                while (m_pos < length) {
+                    CharClass cls = char_classes[static_cast<uint8_t>(m_src[m_pos])];
+                    LexState next = lex_transitions[static_cast<size_t>(state)][static_cast<size_t>(cls)];
+                    if (next == LexState::done) {
+                        break;
                     }
-                    tokens.push_back(Token{TokenType::int_lit, buf, line, column});
-                    buf.clear();
-                } else if (c == '(') {
-                    tokens.push_back(Token{TokenType::open_paren, "(", line, column});
-                } else if (c == ')') {
-                    tokens.push_back(Token{TokenType::close_paren, ")", line, column});
-                } else if (c == ';') {
-                    tokens.push_back(Token{TokenType::semi, ";", line, column});
-                } else if (c == '=') {
-                    tokens.push_back(Token{TokenType::eq, "=", line, column});
-                } else if (c == '+') {
-                    tokens.push_back(Token{TokenType::plus, "+", line, column});
-                } else if (c == '*') {
-                    tokens.push_back(Token{TokenType::star, "*", line, column});
-                } else if (c == '/') {
-                    if (peek().has_value() && peek().value() == '/') {
-                        consume(); // consume the second '/'
-                        while (peek().has_value() && peek().value() != '\n') {
-                            consume(); // consume the rest of the line
-                            column++;
-                        }
-                        if (peek().has_value()) {
-                            consume(); // consume the newline
-                            line++;
-                            column = 1;
+                    state = next;
+                    m_pos = skip_run(state, m_pos + 1);
+                }
+
+                const std::string_view text = m_src.substr(start, m_pos - start);
+                switch (state) {
+                    case LexState::ident: {
+                        const TokenType type = keyword_or_ident(text);
+                        if (type == TokenType::ident) {
+                            return Token{type, text, m_interner.intern(text)};
                         }
-                    } else if (peek().has_value() && peek().value() == '*') {
-                        consume(); // consume the '*'
-                        while (peek().has_value()) {
-                            if (peek().value() == '*' && peek(1).has_value() && peek(1).value() == '/') {
-                                consume(); // consume the '*'
-                                consume(); // consume the '/'
-                                column += 2;
-                                break;
-                            }
-                            if (peek().value() == '\n') {
-                                line++;
-                                column = 1;
-                            } else {
-                                column++;
-                            }
-                            consume();
+                        return Token{type, text};
+                    }
+                    case LexState::number:
+                        return Token{TokenType::int_lit, text};
+                    case LexState::punct:
+                        return Token{punct_types[static_cast<uint8_t>(text[0])], text};
+                    case LexState::slash:
+                        return Token{TokenType::slash, text};
+                    case LexState::relation_eq:
+                        return Token{two_char_type(text), text};
+                    case LexState::relation:
+                        if (text[0] != '!') {
+                            return Token{punct_types[static_cast<uint8_t>(text[0])], text};
                         }
-                    } else {
-                        tokens.push_back(Token{TokenType::slash, "/", line, column});
+                        // '!' only exists as part of "!="
+                        [[fallthrough]];
+                    case LexState::error: {
+                        SourceLocation loc = locate(text);
+                        throw std::runtime_error("Unexpected character: " + std::string(text) + " at line " + std::to_string(loc.line) + " column " + std::to_string(loc.column));
                     }
-                } else if (c == '-') {
-                    tokens.push_back(Token{TokenType::minus, "-", line, column});
-                } else if (c == '{') {
-                    tokens.push_back(Token{TokenType::open_brace, "{", line, column});
-                } else if (c == '}') {
-                    tokens.push_back(Token{TokenType::close_brace, "}", line, column});
-                } else {
-                    throw std::runtime_error("Unexpected character: " + std::string(1, c) + " at line " + std::to_string(line) + " column " + std::to_string(column));
+                    default:
+                        // Whitespace and comments (an unterminated block
+                        // comment simply runs to the end of the file)
+                        track_newlines(start);
+                        break;
                 }
             }
 
-            return tokens;
+            return std::nullopt;
+        }
+
+        // Line and column of a token (or any other view into the source).
+        // Only valid for positions the tokenizer has already passed.
+        SourceLocation locate(std::string_view text) const {
+            return m_lines.locate(static_cast<uint32_t>(text.data() - m_src.data()));
         }
 
     private:
 
-        std::optional<char> peek(int offset = 0) const {
-            if (m_pos + offset < m_src.length()) {
-                return m_src[m_pos + offset];
+        static TokenType keyword_or_ident(std::string_view word) {
+            size_t slot = keyword_table.slot(word);
+            if (keyword_table.used[slot] && keyword_table.slots[slot].text == word) {
+                return keyword_table.slots[slot].type;
             }
-            return std::nullopt;
+            return TokenType::ident;
+        }
+
+        // Skip the characters that keep `state` looping on itself. The long
+        // runs (whitespace, digits, comment text) go through the vectorized
+        // scanners; everything else uses the self-loop class mask.
+        size_t skip_run(LexState state, size_t pos) const {
+            const char* begin = m_src.data();
+            const char* end = begin + m_src.size();
+            switch (state) {
+                case LexState::space:
+                    return scan_skip_whitespace(begin + pos, end) - begin;
+                case LexState::number:
+                    return scan_skip_digits(begin + pos, end) - begin;
+                case LexState::line_comment:
+                    return scan_find(begin + pos, end, '\n') - begin;
+                case LexState::block_comment:
+                    return scan_find(begin + pos, end, '*') - begin;
+                default:
+                    break;
+            }
+            const uint32_t loop = lex_self_loops[static_cast<size_t>(state)];
+            while (pos < m_src.size()
+                   && (loop >> static_cast<uint32_t>(char_classes[static_cast<uint8_t>(m_src[pos])]) & 1)) {
+                pos++;
+            }
+            return pos;
+        }
+
+        // Record the start of every line that begins inside [start, m_pos)
+        void track_newlines(size_t start) {
+            const char* base = m_src.data();
+            scan_newlines(base + start, base + m_pos, [this, base](const char* newline) {
+                m_lines.add_line(static_cast<uint32_t>(newline + 1 - base));
+            });
+        }
+
+        std::string_view m_src;
+        size_t m_pos = 0;
+        LineTable m_lines;
+        Interner& m_interner = Interner::global();
+};
+
+// Lazy token source for the parser. Tokens are lexed only when the parser
+// looks at them and at most `lookahead` of them are buffered at a time, so
+// the token sequence of a file is never materialized as a whole.
+class TokenStream {
+    public:
+        static constexpr size_t lookahead = 4;
+
+        inline explicit TokenStream(Tokenizer& tokenizer) : m_tokenizer(tokenizer) {}
+
+        // Token `offset` positions ahead of the cursor, or nullptr past the
+        // end of input. The token lives in the lookahead window: the pointer
+        // stays valid until `lookahead - 1` more tokens have been consumed,
+        // so anything kept longer has to be copied.
+        const Token* peek(size_t offset = 0) {
+            if (offset >= lookahead) {
+                throw std::out_of_range("TokenStream lookahead exceeded");
+            }
+            while (m_count <= offset) {
+                auto token = m_tokenizer.next();
+                if (!token.has_value()) {
+                    return nullptr;
+                }
+                m_window[(m_head + m_count) % lookahead] = *token;
+                m_count++;
+            }
+            return &m_window[(m_head + offset) % lookahead];
         }
 
-        char consume() {
-            if (m_pos < m_src.length()) {
-                return m_src[m_pos++];
+        // Advance past the current token and return it (same lifetime as peek)
+        const Token* consume() {
+            const Token* token = peek();
+            if (token) {
+                m_head = (m_head + 1) % lookahead;
+                m_count--;
             }
-            throw std::out_of_range("No more characters to consume");
+            return token;
         }
-        const std::string& m_src;
-        int m_pos = 0;
-};
\ No newline at end of file
+
+        SourceLocation locate(std::string_view text) const {
+            return m_tokenizer.locate(text);
+        }
+
+    private:
+        Tokenizer& m_tokenizer;
+        std::array<Token, lookahead> m_window{};
+        size_t m_head = 0;
+        size_t m_count = 0;
+};
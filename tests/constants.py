@@ -0,0 +1,81 @@
+"""Arithmetic with constant operands, over the full 32-bit range.
+
+    constants.py <hydro> [hydro flags...]
+
+Covers the code that depends on a constant's value rather than on the
+program's shape: multiplication and division by constants (strength
+reduction: shifts, shift-and-add, magic-number division) and add, sub and
+compare with immediates (12-bit, shifted by 12, negated, or materialized).
+
+Each program checks one constant against many operands and exits with the
+number of the first check that fails, or 0. The operands are assembled at
+runtime from 16-bit halves, so the folder cannot see them; SCCP at -O2
+would, so run this at -O0 and -O1.
+"""
+
+import random
+import sys
+
+import hy
+import sim
+
+MASK = hy.MASK
+
+rng = random.Random(5)
+
+FACTORS = [2, 3, 5, 6, 7, 9, 10, 12, 15, 17, 24, 25, 31, 33, 40, 45, 63, 64, 100, 127, 255, 256, 641, 1000,
+           1023, 1025, 4097, 65535, 65537, 0x7FFFFFFF, 0x80000000, 0x80000001, 0xFFFFFFFB, 0xFFFFFFFE,
+           0xFFFFFFFF, 3 << 20, 33 * 9, 127 * 8] + [rng.randrange(2, 1 << 32) for _ in range(20)]
+
+IMMEDIATES = [0, 1, 4095, 4096, 0x5000, 0xFFF000, 0xFFF001, 0x1000000, 0xFFFF, 0x10000, 0xFFFF0000,
+              0xFFFFFFFE, 0xFFFF1234, 0x12345678, 0xFFFFF000, 0xFFFFFFFF, 0x80000000]
+
+OPERANDS = [0, 1, 2, 3, 7, 4095, 4096, 0xFFFFFFFF, 0xFFFFFFFE, 0x80000000, 0x7FFFFFFF, 123456789] + \
+           [rng.randrange(1 << 32) for _ in range(6)]
+
+
+def program(checks):
+    """A program that evaluates every check (op, lhs, rhs, x), where one of
+    lhs and rhs is 'x', and exits with the 1-based index of the first that
+    gives the wrong result"""
+    lines = ['let hi = 0;', 'let x = 0;', 'let r = 0;']
+    for i, (op, lhs, rhs, x) in enumerate(checks):
+        want = hy.apply(op, x if lhs == 'x' else lhs, x if rhs == 'x' else rhs)
+        lines += ['hi = %d;' % (x >> 16),
+                  'x = hi * 65536 + %d;' % (x & 0xFFFF),
+                  'r = %s %s %s;' % (lhs, op, rhs),
+                  'if (r != %d) { exit(%d); }' % (want, i + 1)]
+    lines.append('exit(0);')
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    hydro, flags = sys.argv[1], sys.argv[2:]
+    groups = []
+    for c in FACTORS:
+        groups.append([check + (x,) for x in OPERANDS for check in (('*', 'x', c), ('*', c, 'x'), ('/', 'x', c))])
+    for c in IMMEDIATES:
+        near = [c, (c + 1) & MASK, (c - 1) & MASK]
+        groups.append([(op, 'x', c, x) for x in OPERANDS + near for op in ('+', '-', '==', '!=', '<', '<=', '>', '>=')] +
+                      [(op, c, 'x', x) for x in OPERANDS + near for op in ('-', '<', '>=')])
+
+    failures = 0
+    for checks in groups:
+        for start in range(0, len(checks), 250):
+            chunk = checks[start:start + 250]
+            try:
+                status = sim.run_hydro(hydro, program(chunk), flags)[0] & 0xFF
+            except (sim.CompileError, sim.SimulationError) as e:
+                print('checks from %s %s %s: %s' % (chunk[0][1], chunk[0][0], chunk[0][2], e))
+                failures += 1
+                continue
+            if status:
+                op, lhs, rhs, x = chunk[status - 1]
+                print('%s %s %s with x = %d: wrong result' % (lhs, op, rhs, x))
+                failures += 1
+    print('%d programs, %d failed' % (len(groups), failures))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
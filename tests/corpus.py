@@ -0,0 +1,52 @@
+"""Runs the programs in corpus/ through hydro and the simulator.
+
+    corpus.py <hydro> [hydro flags...]
+
+Every program states the status it exits with in a `// exit: N` line. That
+is checked against the reference interpreter as well as against hydro, so
+an expectation cannot drift from the language's semantics.
+"""
+
+import os
+import re
+import sys
+
+import hy
+import sim
+
+CORPUS = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'corpus')
+
+
+def main():
+    hydro, flags = sys.argv[1], sys.argv[2:]
+    failures = 0
+    names = sorted(n for n in os.listdir(CORPUS) if n.endswith('.hy'))
+    for name in names:
+        with open(os.path.join(CORPUS, name)) as f:
+            source = f.read()
+        m = re.search(r'^// exit: (\d+)$', source, re.M)
+        if not m:
+            print('%s: no // exit: line' % name)
+            failures += 1
+            continue
+        expected = int(m.group(1))
+        reference = hy.run(hy.parse(source))
+        if reference != expected:
+            print('%s: says exit %d, the reference interpreter exits with %d' % (name, expected, reference))
+            failures += 1
+            continue
+        try:
+            got = sim.run_hydro(hydro, source, flags)[0] & 0xFF
+        except (sim.CompileError, sim.SimulationError) as e:
+            print('%s: %s' % (name, e))
+            failures += 1
+            continue
+        if got != expected:
+            print('%s: exited with %d, expected %d' % (name, got, expected))
+            failures += 1
+    print('%d of %d programs ok' % (len(names) - failures, len(names)))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,51 @@
+"""Differential fuzzing: random programs through hydro and the simulator,
+checked against the reference interpreter.
+
+    fuzz.py <hydro> [--count N] [--seed S] [--depth D] [--max-literal L]
+            [--variables V] [-- hydro flags...]
+
+Program i is generated from seed S + i, so a failure names the seed that
+reproduces it, and its source is printed.
+"""
+
+import argparse
+import random
+import sys
+
+import hy
+import sim
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('hydro')
+    parser.add_argument('--count', type=int, default=200)
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--depth', type=int, default=3)
+    parser.add_argument('--max-literal', type=int, default=4095)
+    parser.add_argument('--variables', type=int, default=30)
+    argv = sys.argv[1:]
+    split = argv.index('--') if '--' in argv else len(argv)
+    args = parser.parse_args(argv[:split])
+    flags = argv[split + 1:]
+
+    steps = 0
+    for seed in range(args.seed, args.seed + args.count):
+        program = hy.generate(random.Random(seed), args.depth, args.max_literal, args.variables)
+        source = '\n'.join(hy.format_program(program)) + '\n'
+        expected = hy.run(program)
+        try:
+            got, executed, _ = sim.run_hydro(args.hydro, source, flags)
+        except (sim.CompileError, sim.SimulationError) as e:
+            print('seed %d: %s\n%s' % (seed, e, source))
+            return 1
+        if got & 0xFF != expected:
+            print('seed %d: exited with %d, expected %d\n%s' % (seed, got & 0xFF, expected, source))
+            return 1
+        steps += executed
+    print('%d programs ok, %d instructions simulated' % (args.count, steps))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,325 @@
+"""Reference semantics for .hy programs, and a random program generator.
+
+This is the oracle the differential tests compare hydro against: a parser
+and tree-walking interpreter written from the language's definition, sharing
+no code with the compiler. Values are unsigned 32-bit; + - * wrap, / is
+unsigned and x / 0 is 0 (what udiv does), comparisons give 0 or 1, and the
+exit status is the low 8 bits of the value passed to exit(). A program that
+runs off its end exits with 0.
+
+Programs are tuples:
+    ('let', name, expr)   ('assign', name, expr)   ('exit', expr)
+    ('scope', [stmt...])  ('if', [(cond or None, [stmt...]), ...])
+and expressions ('int', n), ('var', name) or (op, lhs, rhs).
+"""
+
+import re
+
+MASK = 0xFFFFFFFF
+
+PRECEDENCE = {'==': 1, '!=': 1, '<': 2, '<=': 2, '>': 2, '>=': 2, '+': 3, '-': 3, '*': 4, '/': 4}
+
+
+def apply(op, a, b):
+    if op == '+':
+        return (a + b) & MASK
+    if op == '-':
+        return (a - b) & MASK
+    if op == '*':
+        return (a * b) & MASK
+    if op == '/':
+        return 0 if b == 0 else a // b
+    return int({'==': a == b, '!=': a != b, '<': a < b, '<=': a <= b, '>': a > b, '>=': a >= b}[op])
+
+
+# ---------------------------------------------------------------- parsing
+
+TOKEN = re.compile(r'\s+|//[^\n]*|/\*.*?(?:\*/|\Z)|(?P<tok>[A-Za-z]+|\d+|==|!=|<=|>=|[-+*/<>=;(){}])', re.S)
+
+
+def tokenize(src):
+    tokens = []
+    pos = 0
+    while pos < len(src):
+        m = TOKEN.match(src, pos)
+        if not m:
+            raise SyntaxError('unexpected character %r' % src[pos])
+        if m.group('tok'):
+            tokens.append(m.group('tok'))
+        pos = m.end()
+    return tokens
+
+
+def parse(src):
+    tokens = tokenize(src)
+    pos = 0
+
+    def peek():
+        return tokens[pos] if pos < len(tokens) else None
+
+    def take(expected=None):
+        nonlocal pos
+        tok = peek()
+        if tok is None or (expected is not None and tok != expected):
+            raise SyntaxError('expected %r, got %r' % (expected, tok))
+        pos += 1
+        return tok
+
+    def primary():
+        tok = take()
+        if tok == '(':
+            e = expr(0)
+            take(')')
+            return e
+        if tok.isdigit():
+            return ('int', int(tok) & MASK)
+        return ('var', tok)
+
+    def expr(min_precedence):
+        left = primary()
+        while peek() in PRECEDENCE and PRECEDENCE[peek()] >= min_precedence:
+            op = take()
+            left = (op, left, expr(PRECEDENCE[op] + 1))
+        return left
+
+    def block():
+        take('{')
+        body = statements()
+        take('}')
+        return body
+
+    def statement():
+        tok = peek()
+        if tok == 'exit':
+            take()
+            take('(')
+            e = expr(0)
+            take(')')
+            take(';')
+            return ('exit', e)
+        if tok == 'let':
+            take()
+            name = take()
+            take('=')
+            e = expr(0)
+            take(';')
+            return ('let', name, e)
+        if tok == 'if':
+            take()
+            arms = []
+            take('(')
+            cond = expr(0)
+            take(')')
+            arms.append((cond, block()))
+            while peek() == 'elif':
+                take()
+                take('(')
+                cond = expr(0)
+                take(')')
+                arms.append((cond, block()))
+            if peek() == 'else':
+                take()
+                arms.append((None, block()))
+            return ('if', arms)
+        if tok == '{':
+            return ('scope', block())
+        name = take()
+        take('=')
+        e = expr(0)
+        take(';')
+        return ('assign', name, e)
+
+    def statements():
+        body = []
+        while peek() is not None and peek() != '}':
+            body.append(statement())
+        return body
+
+    program = statements()
+    if peek() is not None:
+        raise SyntaxError('unexpected %r' % peek())
+    return program
+
+
+# ------------------------------------------------------------ interpreting
+
+class _Exit(Exception):
+    def __init__(self, value):
+        self.value = value
+
+
+def run(program):
+    """The exit status of `program`"""
+    scopes = [{}]
+
+    def lookup(name):
+        for scope in reversed(scopes):
+            if name in scope:
+                return scope
+        raise NameError(name)
+
+    def evaluate(e):
+        if e[0] == 'int':
+            return e[1] & MASK
+        if e[0] == 'var':
+            return lookup(e[1])[e[1]]
+        return apply(e[0], evaluate(e[1]), evaluate(e[2]))
+
+    def execute(body):
+        scopes.append({})
+        try:
+            for s in body:
+                kind = s[0]
+                if kind == 'exit':
+                    raise _Exit(evaluate(s[1]))
+                if kind == 'let':
+                    scopes[-1][s[1]] = evaluate(s[2])
+                elif kind == 'assign':
+                    lookup(s[1])[s[1]] = evaluate(s[2])
+                elif kind == 'scope':
+                    execute(s[1])
+                elif kind == 'if':
+                    for cond, arm in s[1]:
+                        if cond is None or evaluate(cond) != 0:
+                            execute(arm)
+                            break
+        finally:
+            scopes.pop()
+
+    try:
+        execute(program)
+    except _Exit as e:
+        return e.value & 0xFF
+    return 0
+
+
+def format_expr(e):
+    if e[0] == 'int':
+        return str(e[1])
+    if e[0] == 'var':
+        return e[1]
+    return '(' + format_expr(e[1]) + ' ' + e[0] + ' ' + format_expr(e[2]) + ')'
+
+
+def format_program(body, depth=0):
+    pad = '    ' * depth
+    lines = []
+    for s in body:
+        kind = s[0]
+        if kind == 'exit':
+            lines.append(pad + 'exit(' + format_expr(s[1]) + ');')
+        elif kind == 'let':
+            lines.append(pad + 'let ' + s[1] + ' = ' + format_expr(s[2]) + ';')
+        elif kind == 'assign':
+            lines.append(pad + s[1] + ' = ' + format_expr(s[2]) + ';')
+        elif kind == 'scope':
+            lines += [pad + '{'] + format_program(s[1], depth + 1) + [pad + '}']
+        elif kind == 'if':
+            for i, (cond, arm) in enumerate(s[1]):
+                keyword = 'if' if i == 0 else 'elif' if cond is not None else 'else'
+                head = keyword if cond is None else keyword + ' (' + format_expr(cond) + ')'
+                lines += [pad + head + ' {'] + format_program(arm, depth + 1) + [pad + '}']
+    return lines
+
+
+# ------------------------------------------------------------- generating
+
+NAMES = [chr(c) for c in range(ord('a'), ord('z') + 1)] + ['foo', 'bar', 'baz', 'qux']
+
+
+def fold(e):
+    """`e` simplified the way hydro's front-end folder does it: literal
+    operands are computed, and the identities that hold for every value of
+    the other operand are applied. Dividing by an expression that folds to
+    0 is a compile error."""
+    if e[0] in ('int', 'var'):
+        return e
+    op = e[0]
+    lhs, rhs = fold(e[1]), fold(e[2])
+    a = lhs[1] if lhs[0] == 'int' else None
+    b = rhs[1] if rhs[0] == 'int' else None
+    if a is not None and b is not None:
+        return ('int', apply(op, a, b))
+    zero = ('int', 0)
+    if op == '+':
+        if b == 0:
+            return lhs
+        if a == 0:
+            return rhs
+    elif op == '-':
+        if b == 0:
+            return lhs
+        if lhs[0] == 'var' and lhs == rhs:
+            return zero
+    elif op == '*':
+        if b == 1:
+            return lhs
+        if a == 1:
+            return rhs
+        if a == 0 or b == 0:
+            return zero
+    elif op == '/':
+        if b == 1:
+            return lhs
+        if a == 0:
+            return zero
+    else:
+        if lhs[0] == 'var' and lhs == rhs:
+            return ('int', apply(op, 0, 0))
+        if (op == '>=' and b == 0) or (op == '<=' and a == 0):
+            return ('int', 1)
+        if (op == '<' and b == 0) or (op == '>' and a == 0):
+            return zero
+    return (op, lhs, rhs)
+
+
+def generate(rng, depth=3, max_literal=4095, variables=30):
+    """A random program. Variables are declared in nested scopes and
+    shadowed; every read is of a variable in scope, so the program is
+    valid, and it may exit early from any depth."""
+    names = NAMES[:max(1, min(variables, len(NAMES)))]
+
+    def expr(visible, d):
+        if d <= 0 or rng.random() < 0.3:
+            if visible and rng.random() < 0.6:
+                return ('var', rng.choice(visible))
+            r = rng.random()
+            n = rng.randint(0, 5) if r < 0.6 else rng.randint(0, 300) if r < 0.9 else rng.randint(0, max_literal)
+            return ('int', n)
+        op = rng.choice(list(PRECEDENCE))
+        lhs = expr(visible, d - 1)
+        rhs = expr(visible, d - 1)
+        if op == '/' and fold(rhs) == ('int', 0):
+            rhs = ('int', rng.randint(1, 5))
+        return (op, lhs, rhs)
+
+    def block(visible, d, count):
+        body = []
+        local = []
+        for _ in range(count):
+            r = rng.random()
+            reachable = visible + local
+            if r < 0.35:
+                fresh = [n for n in names if n not in local]
+                if fresh:
+                    name = rng.choice(fresh)
+                    body.append(('let', name, expr(reachable, rng.randint(0, 3))))
+                    local.append(name)
+            elif r < 0.6 and reachable:
+                body.append(('assign', rng.choice(reachable), expr(reachable, rng.randint(0, 3))))
+            elif r < 0.75 and d > 0:
+                arms = [(expr(reachable, 2), block(reachable, d - 1, rng.randint(0, 4)))
+                        for _ in range(rng.randint(1, 3))]
+                if rng.random() < 0.5:
+                    arms.append((None, block(reachable, d - 1, rng.randint(0, 4))))
+                body.append(('if', arms))
+            elif r < 0.85 and d > 0:
+                body.append(('scope', block(reachable, d - 1, rng.randint(0, 4))))
+            elif r < 0.9:
+                body.append(('exit', expr(reachable, 2)))
+        return body
+
+    program = block([], depth, rng.randint(3, 12))
+    top = [s[1] for s in program if s[0] == 'let']
+    program.append(('exit', ('var', rng.choice(top)) if top else ('int', 7)))
+    return program
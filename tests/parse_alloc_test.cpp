@@ -0,0 +1,82 @@
+// Parsing must cost time and memory linear in the size of the input. A
+// parser that copies subtrees into their parents is quadratic on long
+// operator chains, and that shows up as allocated bytes growing faster than
+// the chain.
+//
+// Parses `exit(x*2 + x*2 + ... + x*2);` at 10k, 20k, 40k and 80k terms under
+// a counting operator new and checks that
+//   - the AST has exactly the nodes the terms call for, and
+//   - heap allocations and bytes per term stay within a factor of two of
+//     the smallest size (vector growth rounds capacities up to a power of
+//     two, so the ratio moves a little; quadratic copying would grow it
+//     eightfold over this range).
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "alloc_counter.hpp"
+#include "parser.hpp"
+
+struct Sample {
+    size_t terms;
+    size_t nodes;
+    AllocationCount allocated;
+};
+
+static std::string generate_chain(size_t terms) {
+    std::string src = "let x = 3;\nexit(";
+    for (size_t i = 0; i < terms; i++) {
+        src += i == 0 ? "x*2" : " + x*2";
+    }
+    src += ");\n";
+    return src;
+}
+
+static Sample parse(size_t terms) {
+    const std::string src = generate_chain(terms);
+    AllocationScope scope;
+    Tokenizer tokenizer(src);
+    TokenStream tokens(tokenizer);
+    Parser parser(tokens, src);
+    const NodeProgram program = parser.parse();
+    return Sample{terms, program.exprs.size(), scope.now()};
+}
+
+int main() {
+    // Intern `x` up front, so that no sample pays for the interner's tables
+    parse(1);
+
+    bool ok = true;
+    auto check = [&](bool condition, const std::string& message) {
+        if (!condition) {
+            std::cerr << "FAIL: " << message << std::endl;
+            ok = false;
+        }
+    };
+
+    Sample first{};
+    std::cout << std::setw(8) << "terms" << std::setw(10) << "nodes" << std::setw(14) << "allocations"
+              << std::setw(14) << "bytes" << std::setw(16) << "bytes/term" << "\n";
+    for (size_t terms = 10000; terms <= 80000; terms *= 2) {
+        const Sample sample = parse(terms);
+        std::cout << std::setw(8) << sample.terms << std::setw(10) << sample.nodes
+                  << std::setw(14) << sample.allocated.allocations << std::setw(14) << sample.allocated.bytes
+                  << std::setw(16) << sample.allocated.bytes / terms << "\n";
+
+        // x, 2 and * per term, a + between terms, and the 3 of the let
+        check(sample.nodes == 4 * terms, std::to_string(terms) + " terms: " + std::to_string(sample.nodes) +
+                                             " nodes, expected " + std::to_string(4 * terms));
+        if (terms == 10000) {
+            first = sample;
+            continue;
+        }
+        const double scale = static_cast<double>(terms) / static_cast<double>(first.terms);
+        check(static_cast<double>(sample.allocated.allocations) <= 2 * scale * static_cast<double>(first.allocated.allocations),
+              std::to_string(terms) + " terms: allocations grew faster than the input");
+        check(static_cast<double>(sample.allocated.bytes) <= 2 * scale * static_cast<double>(first.allocated.bytes),
+              std::to_string(terms) + " terms: allocated bytes grew faster than the input");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+"""A simulator for the subset of AArch64 that hydro emits.
+
+Runs out.s from `_main` until the exit syscall (svc with x16 = 1) or a ret,
+and returns (w0, instructions executed, memory accesses). Immediates are
+checked against what the instruction can encode, so an add #4096 or a
+mov #70000 fails here the way it would fail in the assembler.
+"""
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+M32 = 0xFFFFFFFF
+M64 = (1 << 64) - 1
+
+CONDITIONS = {
+    'eq': lambda n, z, c, v: z,
+    'ne': lambda n, z, c, v: not z,
+    'hs': lambda n, z, c, v: c,
+    'cs': lambda n, z, c, v: c,
+    'lo': lambda n, z, c, v: not c,
+    'cc': lambda n, z, c, v: not c,
+    'hi': lambda n, z, c, v: c and not z,
+    'ls': lambda n, z, c, v: not c or z,
+    'ge': lambda n, z, c, v: n == v,
+    'lt': lambda n, z, c, v: n != v,
+    'gt': lambda n, z, c, v: not z and n == v,
+    'le': lambda n, z, c, v: z or n != v,
+}
+
+
+class SimulationError(Exception):
+    pass
+
+
+def _imm(text):
+    return int(text.strip().lstrip('#'), 0)
+
+
+def _compare(a, b, bits):
+    mask = (1 << bits) - 1
+    a &= mask
+    b &= mask
+    r = (a - b) & mask
+    n = (r >> (bits - 1)) & 1
+    sa = (a >> (bits - 1)) & 1
+    sb = (b >> (bits - 1)) & 1
+    return (n, r == 0, a >= b, sa != sb and n != sa)
+
+
+def _check_encodable(op, operands, line):
+    if op in ('mov', 'movz', 'movk', 'movn') and operands[1].startswith('#'):
+        if not 0 <= _imm(operands[1]) <= 0xFFFF:
+            raise SimulationError('immediate out of range: ' + line)
+    if op in ('add', 'sub', 'cmp'):
+        immediates = [o for o in operands if o.startswith('#')]
+        if immediates and not 0 <= _imm(immediates[0]) <= 4095:
+            raise SimulationError('immediate out of range: ' + line)
+        if operands[-1].startswith('lsl') and immediates and operands[-1].replace(' ', '') != 'lsl#12':
+            raise SimulationError('bad immediate shift: ' + line)
+
+
+def run(asm, max_steps=10_000_000):
+    lines = []
+    labels = {}
+    for raw in asm.splitlines():
+        line = raw.split('//')[0].strip()
+        if line.endswith(':'):
+            labels[line[:-1]] = len(lines)
+            continue
+        if not line or line.startswith(('#', '.')):
+            continue
+        lines.append(line)
+
+    regs = [0] * 32
+    sp = 1 << 20
+    memory = {}
+    flags = None
+
+    def read(r):
+        if r in ('wzr', 'xzr'):
+            return 0
+        if r == 'sp':
+            return sp
+        value = regs[int(r[1:])]
+        return value & M32 if r[0] == 'w' else value
+
+    def write(r, value):
+        nonlocal sp
+        if r == 'sp':
+            sp = value & M64
+        elif r not in ('wzr', 'xzr'):
+            regs[int(r[1:])] = value & (M32 if r[0] == 'w' else M64)
+
+    def operand(text):
+        text = text.strip()
+        if text.startswith('#') or re.match(r'^-?\d', text):
+            return _imm(text)
+        return read(text)
+
+    def address(text):
+        # [base], [base, #off], [base, #off]! or [base], #off
+        m = re.match(r'\[(\w+)(?:,\s*#?(-?\w+))?\](!)?(?:,\s*#?(-?\w+))?$', text)
+        base = read(m.group(1))
+        offset = int(m.group(2), 0) if m.group(2) else 0
+        if m.group(3):
+            return base + offset, (m.group(1), base + offset)
+        if m.group(4):
+            return base, (m.group(1), base + int(m.group(4), 0))
+        return base + offset, None
+
+    def load(at, size):
+        return sum(memory.get(at + i, 0) << (8 * i) for i in range(size))
+
+    def store(at, value, size):
+        for i in range(size):
+            memory[at + i] = (value >> (8 * i)) & 0xFF
+
+    pc = labels.get('_main', 0)
+    steps = 0
+    accesses = 0
+    while True:
+        steps += 1
+        if steps > max_steps:
+            raise SimulationError('no exit after %d instructions' % max_steps)
+        if pc >= len(lines):
+            raise SimulationError('ran off the end of the program')
+        line = lines[pc]
+        pc += 1
+        parts = line.split(None, 1)
+        op = parts[0]
+        a = [x.strip() for x in re.split(r',(?![^\[]*\])', parts[1])] if len(parts) > 1 else []
+        bits = 32 if a and a[0].startswith('w') else 64
+        mask = M32 if bits == 32 else M64
+        _check_encodable(op, a, line)
+
+        def shifted(i):
+            value = operand(a[i])
+            if len(a) > i + 1:
+                m = re.match(r'(lsl|lsr)\s+#?(\d+)', a[i + 1])
+                if m:
+                    value = value << int(m.group(2)) if m.group(1) == 'lsl' else value >> int(m.group(2))
+            return value
+
+        if op == 'mov':
+            write(a[0], operand(a[1]))
+        elif op == 'movz':
+            write(a[0], shifted(1))
+        elif op == 'movk':
+            shift = int(re.match(r'lsl\s+#?(\d+)', a[2]).group(1)) if len(a) > 2 else 0
+            write(a[0], (read(a[0]) & ~(0xFFFF << shift)) | (_imm(a[1]) << shift))
+        elif op == 'movn':
+            write(a[0], ~shifted(1))
+        elif op in ('add', 'sub', 'subs'):
+            x = read(a[1])
+            y = shifted(2) & mask
+            if op == 'subs':
+                flags = _compare(x, y, bits)
+            write(a[0], (x + y if op == 'add' else x - y) & mask)
+        elif op == 'neg':
+            write(a[0], -read(a[1]))
+        elif op == 'mul':
+            write(a[0], read(a[1]) * read(a[2]))
+        elif op == 'madd':
+            write(a[0], read(a[1]) * read(a[2]) + read(a[3]))
+        elif op == 'msub':
+            write(a[0], read(a[3]) - read(a[1]) * read(a[2]))
+        elif op == 'umull':
+            write(a[0], (read(a[1]) & M32) * (read(a[2]) & M32))
+        elif op == 'umulh':
+            write(a[0], (read(a[1]) * read(a[2])) >> 64)
+        elif op == 'udiv':
+            divisor = read(a[2])
+            write(a[0], 0 if divisor == 0 else read(a[1]) // divisor)
+        elif op == 'lsl':
+            write(a[0], read(a[1]) << (operand(a[2]) % bits))
+        elif op == 'lsr':
+            write(a[0], (read(a[1]) & mask) >> (operand(a[2]) % bits))
+        elif op == 'cmp':
+            flags = _compare(read(a[0]), shifted(1), bits)
+        elif op == 'cset':
+            write(a[0], 1 if CONDITIONS[a[1]](*flags) else 0)
+        elif op == 'b':
+            pc = labels[a[0]]
+        elif op.startswith('b.'):
+            if CONDITIONS[op[2:]](*flags):
+                pc = labels[a[0]]
+        elif op == 'cbz':
+            if read(a[0]) == 0:
+                pc = labels[a[1]]
+        elif op == 'cbnz':
+            if read(a[0]) != 0:
+                pc = labels[a[1]]
+        elif op in ('str', 'ldr'):
+            size = 4 if a[0][0] == 'w' else 8
+            at, writeback = address(','.join(a[1:]))
+            accesses += 1
+            if op == 'str':
+                store(at, read(a[0]), size)
+            else:
+                write(a[0], load(at, size))
+            if writeback:
+                write(*writeback)
+        elif op in ('stp', 'ldp'):
+            size = 4 if a[0][0] == 'w' else 8
+            at, writeback = address(','.join(a[2:]))
+            accesses += 1
+            if op == 'stp':
+                store(at, read(a[0]), size)
+                store(at + size, read(a[1]), size)
+            else:
+                write(a[0], load(at, size))
+                write(a[1], load(at + size, size))
+            if writeback:
+                write(*writeback)
+        elif op == 'svc':
+            if regs[16] != 1:
+                raise SimulationError('unexpected syscall %d' % regs[16])
+            return regs[0] & M32, steps, accesses
+        elif op == 'ret':
+            return regs[0] & M32, steps, accesses
+        else:
+            raise SimulationError('unsupported instruction: ' + line)
+
+
+class CompileError(Exception):
+    pass
+
+
+def run_hydro(hydro, source, flags=()):
+    """Compiles `source` with hydro and simulates the result; returns what
+    run() does. hydro writes out.s to its working directory, and then fails
+    to assemble it off macOS, so only a missing out.s counts as failure."""
+    with tempfile.TemporaryDirectory() as work:
+        path = os.path.join(work, 'test.hy')
+        with open(path, 'w') as f:
+            f.write(source)
+        result = subprocess.run([os.path.abspath(hydro), *flags, path], cwd=work, capture_output=True, text=True)
+        asm_path = os.path.join(work, 'out.s')
+        if not os.path.exists(asm_path):
+            raise CompileError(result.stderr.strip() or 'no out.s')
+        with open(asm_path) as f:
+            return run(f.read())
+
+
+if __name__ == '__main__':
+    with open(sys.argv[1]) as f:
+        print(*run(f.read()))